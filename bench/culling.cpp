@@ -0,0 +1,134 @@
+// Culls a field of randomly placed and rotated boxes against a moving camera with FrustumCuller, on one
+// thread and split over a ThreadPool, and compares both with a plain loop that tests one object at a time.
+// Usage: bench.culling [object count] [frames]
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.culling.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static void perspective(float fovy, float aspect, float zNear, float zFar, float m[])
+{
+    auto f = 1.0f / std::tan(fovy * 0.5f);
+    for (int i = 0; i < 16; i++) m[i] = 0.0f;
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1.0f;
+    m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+// View matrix of a camera at the origin turned yaw radians around the y axis
+static void yawView(float yaw, float m[])
+{
+    auto c = std::cos(yaw), s = std::sin(yaw);
+    const float view[] = { c, 0.0f, s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -s, 0.0f, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    for (int i = 0; i < 16; i++) m[i] = view[i];
+}
+
+// One object at a time: the world space box against the six normalized planes
+static size_t cullReference(const FrustumCuller& culler, const float viewProjection[], std::vector<FrustumCuller::Handle>& visible)
+{
+    float planes[6][4];
+    for (int i = 0; i < 3; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            planes[i * 2][c] = viewProjection[c * 4 + 3] + viewProjection[c * 4 + i];
+            planes[i * 2 + 1][c] = viewProjection[c * 4 + 3] - viewProjection[c * 4 + i];
+        }
+        for (int p = i * 2; p < i * 2 + 2; p++)
+        {
+            auto length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+            for (int c = 0; c < 4; c++) planes[p][c] /= length;
+        }
+    }
+
+    visible.clear();
+    for (FrustumCuller::Handle handle = 0; handle < culler.size(); handle++)
+    {
+        float boundsMin[3], boundsMax[3];
+        culler.bounds(handle, boundsMin, boundsMax);
+
+        bool inside = true;
+        for (int p = 0; inside && p < 6; p++)
+        {
+            float corner[3];
+            for (int c = 0; c < 3; c++) corner[c] = planes[p][c] >= 0.0f ? boundsMax[c] : boundsMin[c];
+            inside = planes[p][0] * corner[0] + planes[p][1] * corner[1] + planes[p][2] * corner[2] + planes[p][3] >= 0.0f;
+        }
+        if (inside) visible.push_back(handle);
+    }
+    return visible.size();
+}
+
+int main(int argc, char* argv[])
+{
+    auto count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    auto frames = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    FrustumCuller culler;
+    uint32_t noise = 2463534242u;
+    auto random = [&noise] () { noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5; return float(noise % 100000) / 100000.0f; };
+
+    const float boxMin[] = { -1.0f, -1.0f, -1.0f }, boxMax[] = { 1.0f, 1.0f, 1.0f };
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        auto angle = random() * 6.2831853f, scale = 0.5f + random() * 2.0f;
+        auto c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+        const float model[] = { c, 0.0f, -s, 0.0f, 0.0f, scale, 0.0f, 0.0f, s, 0.0f, c, 0.0f,
+                                random() * 2000.0f - 1000.0f, random() * 200.0f - 100.0f, random() * 2000.0f - 1000.0f, 1.0f };
+        culler.add(boxMin, boxMax, std::sqrt(3.0f), model);
+    }
+    auto added = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%d objects added in %.2f ms\n", count, added);
+
+    float projection[16], view[16], viewProjection[16];
+    perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f, projection);
+
+    ThreadPool pool;
+    std::vector<FrustumCuller::Handle> visible, reference;
+    double serialTime = 0.0, poolTime = 0.0, referenceTime = 0.0;
+    size_t visibleTotal = 0, mismatches = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        yawView(6.2831853f * float(frame) / float(frames), view);
+        simdMultiplyMatrices(projection, view, viewProjection);
+
+        start = std::chrono::steady_clock::now();
+        culler.cull(viewProjection, visible);
+        auto middle = std::chrono::steady_clock::now();
+        serialTime += std::chrono::duration<double, std::milli>(middle - start).count();
+
+        culler.cull(viewProjection, visible, &pool);
+        auto end = std::chrono::steady_clock::now();
+        poolTime += std::chrono::duration<double, std::milli>(end - middle).count();
+
+        cullReference(culler, viewProjection, reference);
+        referenceTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - end).count();
+
+        // The culler may also drop boxes whose sphere is outside, but never one the box test keeps out
+        visibleTotal += visible.size();
+        size_t r = 0;
+        for (auto handle : visible)
+        {
+            while (r < reference.size() && reference[r] < handle) r++;
+            if (r == reference.size() || reference[r] != handle) mismatches++;
+        }
+    }
+
+    std::printf("%zu of %d visible per frame on average\n", visibleTotal / size_t(frames), count);
+    std::printf("reference   %8.3f ms per frame\n", referenceTime / frames);
+    std::printf("simd        %8.3f ms per frame (%.1fx)\n", serialTime / frames, referenceTime / serialTime);
+    std::printf("simd + pool %8.3f ms per frame (%.1fx, %zu threads)\n", poolTime / frames, referenceTime / poolTime, pool.size());
+    std::printf("%zu objects kept that the reference culls\n", mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
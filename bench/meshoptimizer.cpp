@@ -0,0 +1,129 @@
+// Runs MeshOptimizer::optimize on generated meshes and prints the ACMR and ATVR before and after,
+// together with the time it took. The shuffled meshes have their triangles and vertices in random order,
+// which is the worst case for the vertex cache.
+// Usage: bench.meshoptimizer [grid size]
+
+#include <gl.utilities/gl.utilities.meshoptimizer.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Position
+{
+    typedef float value_type;
+    float x, y, z;
+};
+
+struct BenchVertex
+{
+    Position pos;
+};
+
+struct Mesh
+{
+    std::string name;
+    std::vector<BenchVertex> verts;
+    std::vector<unsigned int> indices;
+};
+
+static Mesh generateGrid(int size)
+{
+    Mesh mesh;
+    mesh.name = "grid " + std::to_string(size) + "x" + std::to_string(size);
+    for (int y = 0; y <= size; y++)
+    {
+        for (int x = 0; x <= size; x++) mesh.verts.push_back({ { float(x), float(y), 0.0f } });
+    }
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            auto corner = (unsigned int)(y * (size + 1) + x);
+            auto below = corner + (unsigned int)(size + 1);
+            mesh.indices.insert(mesh.indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    }
+    return mesh;
+}
+
+static Mesh generateSphere(int segments, int rings)
+{
+    Mesh mesh;
+    mesh.name = "sphere " + std::to_string(segments) + "x" + std::to_string(rings);
+    const float pi = 3.14159265358979323846f;
+    for (int ring = 0; ring <= rings; ring++)
+    {
+        auto theta = pi * float(ring) / float(rings);
+        for (int segment = 0; segment <= segments; segment++)
+        {
+            auto phi = 2.0f * pi * float(segment) / float(segments);
+            mesh.verts.push_back({ { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) } });
+        }
+    }
+    for (int ring = 0; ring < rings; ring++)
+    {
+        for (int segment = 0; segment < segments; segment++)
+        {
+            auto corner = (unsigned int)(ring * (segments + 1) + segment);
+            auto below = corner + (unsigned int)(segments + 1);
+            mesh.indices.insert(mesh.indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    }
+    return mesh;
+}
+
+// Shuffles the triangles and renumbers the vertices randomly
+static Mesh shuffle(Mesh mesh)
+{
+    uint32_t noise = 2463534242u;
+    auto next = [&noise] () { noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5; return noise; };
+
+    auto triangleCount = mesh.indices.size() / 3;
+    for (auto i = triangleCount; i > 1; i--)
+    {
+        auto j = size_t(next() % i);
+        for (size_t c = 0; c < 3; c++) std::swap(mesh.indices[(i - 1) * 3 + c], mesh.indices[j * 3 + c]);
+    }
+
+    std::vector<unsigned int> order(mesh.verts.size());
+    for (size_t v = 0; v < order.size(); v++) order[v] = (unsigned int)(v);
+    for (auto i = order.size(); i > 1; i--) std::swap(order[i - 1], order[size_t(next() % i)]);
+
+    std::vector<BenchVertex> verts(mesh.verts.size());
+    for (size_t v = 0; v < order.size(); v++) verts[order[v]] = mesh.verts[v];
+    for (auto& index : mesh.indices) index = order[index];
+    mesh.verts.swap(verts);
+
+    mesh.name = "shuffled " + mesh.name;
+    return mesh;
+}
+
+int main(int argc, char* argv[])
+{
+    auto size = argc > 1 ? std::atoi(argv[1]) : 256;
+
+    std::vector<Mesh> meshes;
+    meshes.push_back(generateGrid(size));
+    meshes.push_back(generateSphere(size, size / 2));
+    meshes.push_back(shuffle(generateGrid(size)));
+    meshes.push_back(shuffle(generateSphere(size, size / 2)));
+
+    MeshOptimizer optimizer;
+    std::printf("%-24s %9s %9s %15s %15s %10s\n", "mesh", "vertices", "triangles", "acmr", "atvr", "time");
+    for (auto& mesh : meshes)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto stats = optimizer.optimize(mesh.verts, mesh.indices, std::vector<std::pair<size_t, size_t>>());
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-24s %9zu %9zu %6.3f -> %5.3f %6.3f -> %5.3f %7.2f ms\n", mesh.name.c_str(), mesh.verts.size(), mesh.indices.size() / 3,
+                    stats.acmrBefore, stats.acmrAfter, stats.atvrBefore, stats.atvrAfter, elapsed);
+    }
+
+    return 0;
+}
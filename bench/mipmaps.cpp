@@ -0,0 +1,84 @@
+// Times MipmapGenerator on a generated 4K RGBA8 image with every filter, in sRGB and linear space. The
+// same source is built twice: bench.mipmaps uses SSE2 or NEON, bench.mipmaps.scalar is built with
+// GL_UTILITIES_NO_SIMD. Both print a checksum of every chain, so their outputs can be compared.
+// Usage: bench.mipmaps [size] [runs]
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.mipmaps.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static std::vector<unsigned char> generateImage(int size)
+{
+    std::vector<unsigned char> pixels(size_t(size) * size_t(size) * 4);
+    uint32_t noise = 12345;
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            noise = noise * 1664525u + 1013904223u;
+            auto pixel = &pixels[(size_t(y) * size_t(size) + size_t(x)) * 4];
+            pixel[0] = static_cast<unsigned char>((x * 255) / size);
+            pixel[1] = static_cast<unsigned char>(((x / 16 + y / 16) & 1) != 0 ? 230 : 20);
+            pixel[2] = static_cast<unsigned char>(noise >> 24);
+            pixel[3] = static_cast<unsigned char>((y * 255) / size);
+        }
+    }
+    return pixels;
+}
+
+static uint64_t checksum(const MipChain& chain)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto& level : chain.levels)
+    {
+        for (auto value : level.pixels) hash = (hash ^ value) * 1099511628211ull;
+    }
+    return hash;
+}
+
+int main(int argc, char* argv[])
+{
+    auto size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    auto runs = argc > 2 ? std::atoi(argv[2]) : 3;
+
+#if defined(GL_UTILITIES_SSE2)
+    const char* path = "SSE2";
+#elif defined(GL_UTILITIES_NEON)
+    const char* path = "NEON";
+#else
+    const char* path = "scalar";
+#endif
+    std::printf("%s, %dx%d, best of %d runs\n", path, size, size, runs);
+
+    auto image = generateImage(size);
+    MipmapGenerator generator;
+    MipChain chain;
+
+    const MipFilter filters[] = { MipFilter::Box, MipFilter::Kaiser };
+    const char* filterNames[] = { "box", "kaiser" };
+    for (int f = 0; f < 2; f++)
+    {
+        for (int srgb = 1; srgb >= 0; srgb--)
+        {
+            double best = 0.0;
+            for (int run = 0; run < runs; run++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                generator.generate(image.data(), size, size, chain, filters[f], srgb != 0);
+                auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (run == 0 || elapsed < best) best = elapsed;
+            }
+
+            std::printf("%-6s %-6s %9.2f ms, %2d levels, checksum %016llx\n", filterNames[f], srgb != 0 ? "srgb" : "linear",
+                        best, int(chain.levels.size()), static_cast<unsigned long long>(checksum(chain)));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Compares cold and warm startup of N programs with a ProgramBinaryCache: the cold run compiles every
+// program from source and stores its binary, the warm run loads the same programs from the cache.
+// Usage: bench.programcache [program count] [cache directory]
+
+#include <GL/glcorearb.h>
+
+#include "headlesscontext.h"
+
+#include <gl.utilities/gl.utilities.shaders.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static std::string vertexSource(int variant, long long salt)
+{
+    return "#version 330 core\n"
+           "// variant " + std::to_string(variant) + " run " + std::to_string(salt) + "\n"
+           "#define VARIANT " + std::to_string(variant) + "\n"
+           "layout(location = 0) in vec3 vertex;\n"
+           "layout(location = 1) in vec3 normal;\n"
+           "uniform mat4 u_projection;\n"
+           "uniform mat4 u_view;\n"
+           "uniform mat4 u_model;\n"
+           "out vec3 f_normal;\n"
+           "void main()\n"
+           "{\n"
+           "    vec4 position = u_model * vec4(vertex, 1.0);\n"
+           "    for (int i = 0; i < VARIANT % 8; i++) position.xyz += sin(position.yzx * float(i + 1)) * 0.01;\n"
+           "    f_normal = mat3(u_model) * normal;\n"
+           "    gl_Position = u_projection * u_view * position;\n"
+           "}\n";
+}
+
+static std::string fragmentSource(int variant)
+{
+    return "#version 330 core\n"
+           "#define VARIANT " + std::to_string(variant) + "\n"
+           "uniform vec3 u_light;\n"
+           "in vec3 f_normal;\n"
+           "out vec4 color;\n"
+           "void main()\n"
+           "{\n"
+           "    float shade = max(dot(normalize(f_normal), normalize(u_light)), 0.0);\n"
+           "    for (int i = 0; i < VARIANT % 5; i++) shade = shade * shade + 0.1 * float(i);\n"
+           "    color = vec4(vec3(shade), 1.0);\n"
+           "}\n";
+}
+
+// Compiles all programs through the cache and returns the milliseconds it took
+static double run(ProgramBinaryCache* cache, int count, long long salt, int& fromCache, int& failed)
+{
+    fromCache = failed = 0;
+    std::vector<std::unique_ptr<CompiledShader>> shaders;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+    {
+        shaders.emplace_back(new CompiledShader());
+        shaders.back()->setBinaryCache(cache);
+        if (!shaders.back()->compile(vertexSource(i, salt), fragmentSource(i))) failed++;
+        if (shaders.back()->_pendingFromCache) fromCache++;
+    }
+    glFinish();
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& shader : shaders) GLState::current().deleteProgram(shader->_shaderId);
+
+    return elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+    auto count = argc > 1 ? std::atoi(argv[1]) : 100;
+    std::string directory = argc > 2 ? argv[2] : "programcache.bench";
+
+    if (!createHeadlessContext()) return 1;
+    std::printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    ProgramBinaryCache cache(directory);
+    if (!cache.supported())
+    {
+        std::printf("The driver has no program binary formats\n");
+        return 1;
+    }
+
+    // A new salt per run gives new sources, so the first pass never finds stored binaries
+    auto salt = static_cast<long long>(std::chrono::system_clock::now().time_since_epoch().count());
+    int fromCache = 0, failed = 0;
+
+    auto cold = run(&cache, count, salt, fromCache, failed);
+    std::printf("cold: %4d programs in %9.2f ms (%7.3f ms each), %d from cache, %d failed\n", count, cold, cold / count, fromCache, failed);
+
+    auto warm = run(&cache, count, salt, fromCache, failed);
+    std::printf("warm: %4d programs in %9.2f ms (%7.3f ms each), %d from cache, %d failed\n", count, warm, warm / count, fromCache, failed);
+    std::printf("speedup %.1fx\n", warm > 0.0 ? cold / warm : 0.0);
+
+    for (int i = 0; i < count; i++) std::remove(cache.filename(cache.key(vertexSource(i, salt), fragmentSource(i))).c_str());
+
+    return failed == 0 ? 0 : 1;
+}
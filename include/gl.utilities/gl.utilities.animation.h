@@ -0,0 +1,148 @@
+#ifndef GL_UTILITIES_ANIMATION_H
+#define GL_UTILITIES_ANIMATION_H
+
+#include "gl.utilities.simd.h"
+#include "gl.utilities.threadpool.h"
+
+#include <vector>
+#include <cstring>
+
+// Bone hierarchy, parents have to come before their children. Inverse bind poses are column major
+// 4x4 matrices, 16 floats per bone.
+struct Skeleton
+{
+    std::vector<int> parents;
+    std::vector<float> inverseBindPoses;
+
+    size_t boneCount() const { return this->parents.size(); }
+};
+
+// Local translation, rotation (quaternion) and scale per bone in structure of arrays layout. The
+// arrays are padded to a multiple of four bones so the kernels can always work on four at once.
+struct LocalPose
+{
+    std::vector<float> translationX, translationY, translationZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    void resize(size_t boneCount)
+    {
+        auto padded = (boneCount + 3) & ~size_t(3);
+        for (auto channel : { &translationX, &translationY, &translationZ, &rotationX, &rotationY, &rotationZ }) channel->resize(padded, 0.0f);
+        for (auto channel : { &rotationW, &scaleX, &scaleY, &scaleZ }) channel->resize(padded, 1.0f);
+    }
+
+    size_t capacity() const { return this->translationX.size(); }
+};
+
+// One character to evaluate. The palette receives the skinning matrices, 16 floats per bone or the
+// three rows of the affine matrix (12 floats) when compact. Point it at SkinnedShader::reservePalette
+// to write straight into the mapped bone buffer.
+struct AnimatedCharacter
+{
+    const Skeleton* skeleton;
+    const LocalPose* pose;
+    float* palette;
+    bool compact;
+};
+
+// Computes global and skinning matrices from local poses. The local matrices are built four bones at
+// a time, the hierarchy is walked with 4x4 SIMD matrix products and characters are spread over the
+// threads of a pool.
+class PaletteEvaluator
+{
+    ThreadPool* _pool;
+
+    // Local matrices of four bones, one bone per lane
+    static void localMatrices(const LocalPose& pose, size_t first, float* matrices)
+    {
+        auto qx = simdLoad(&pose.rotationX[first]), qy = simdLoad(&pose.rotationY[first]);
+        auto qz = simdLoad(&pose.rotationZ[first]), qw = simdLoad(&pose.rotationW[first]);
+        auto sx = simdLoad(&pose.scaleX[first]), sy = simdLoad(&pose.scaleY[first]), sz = simdLoad(&pose.scaleZ[first]);
+
+        auto one = simdSet1(1.0f), two = simdSet1(2.0f);
+        auto xx = simdMul(qx, qx), yy = simdMul(qy, qy), zz = simdMul(qz, qz);
+        auto xy = simdMul(qx, qy), xz = simdMul(qx, qz), yz = simdMul(qy, qz);
+        auto wx = simdMul(qw, qx), wy = simdMul(qw, qy), wz = simdMul(qw, qz);
+
+        Float4 elements[12] = {
+            simdMul(simdSub(one, simdMul(two, simdAdd(yy, zz))), sx),
+            simdMul(simdMul(two, simdAdd(xy, wz)), sx),
+            simdMul(simdMul(two, simdSub(xz, wy)), sx),
+            simdMul(simdMul(two, simdSub(xy, wz)), sy),
+            simdMul(simdSub(one, simdMul(two, simdAdd(xx, zz))), sy),
+            simdMul(simdMul(two, simdAdd(yz, wx)), sy),
+            simdMul(simdMul(two, simdAdd(xz, wy)), sz),
+            simdMul(simdMul(two, simdSub(yz, wx)), sz),
+            simdMul(simdSub(one, simdMul(two, simdAdd(xx, yy))), sz),
+            simdLoad(&pose.translationX[first]),
+            simdLoad(&pose.translationY[first]),
+            simdLoad(&pose.translationZ[first]),
+        };
+
+        static const int targets[12] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14 };
+        float lanes[4];
+        for (int element = 0; element < 12; element++)
+        {
+            simdStore(lanes, elements[element]);
+            for (int lane = 0; lane < 4; lane++) matrices[lane * 16 + targets[element]] = lanes[lane];
+        }
+        for (int lane = 0; lane < 4; lane++)
+        {
+            matrices[lane * 16 + 3] = matrices[lane * 16 + 7] = matrices[lane * 16 + 11] = 0.0f;
+            matrices[lane * 16 + 15] = 1.0f;
+        }
+    }
+
+public:
+    PaletteEvaluator(ThreadPool* pool = nullptr) : _pool(pool) { }
+    virtual ~PaletteEvaluator() { }
+
+    // Evaluates one character, globals needs room for 16 floats per bone rounded up to four bones
+    static void evaluate(const AnimatedCharacter& character, float* globals)
+    {
+        auto& skeleton = *character.skeleton;
+        auto& pose = *character.pose;
+        auto boneCount = skeleton.boneCount();
+
+        for (size_t first = 0; first < boneCount; first += 4) localMatrices(pose, first, globals + first * 16);
+
+        for (size_t bone = 0; bone < boneCount; bone++)
+        {
+            auto parent = skeleton.parents[bone];
+            if (parent >= 0) simdMultiplyMatrices(globals + size_t(parent) * 16, globals + bone * 16, globals + bone * 16);
+        }
+
+        float skinning[16];
+        for (size_t bone = 0; bone < boneCount; bone++)
+        {
+            auto target = character.compact ? skinning : character.palette + bone * 16;
+            simdMultiplyMatrices(globals + bone * 16, &skeleton.inverseBindPoses[bone * 16], target);
+            if (!character.compact) continue;
+
+            auto rows = character.palette + bone * 12;
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 4; column++) rows[row * 4 + column] = skinning[column * 4 + row];
+            }
+        }
+    }
+
+    void evaluate(const std::vector<AnimatedCharacter>& characters)
+    {
+        auto work = [&characters] (size_t begin, size_t end)
+        {
+            std::vector<float> globals;
+            for (size_t i = begin; i < end; i++)
+            {
+                globals.resize(characters[i].pose->capacity() * 16);
+                evaluate(characters[i], globals.data());
+            }
+        };
+
+        if (this->_pool != nullptr) this->_pool->parallelFor(characters.size(), 4, work);
+        else work(0, characters.size());
+    }
+};
+
+#endif // GL_UTILITIES_ANIMATION_H
@@ -0,0 +1,253 @@
+#ifndef GL_UTILITIES_ASYNCLOADERS_H
+#define GL_UTILITIES_ASYNCLOADERS_H
+
+#include "gl.utilities.mipmaps.h"
+#include "gl.utilities.state.h"
+#include "gl.utilities.textures.h"
+#include "gl.utilities.threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Unbounded queue for many producers and one consumer without locks. Producers swap themselves in
+// as the head, the consumer follows the next pointers from a stub node.
+template <class T>
+class MpscQueue
+{
+    struct Node
+    {
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> _head;
+    Node* _tail;
+
+public:
+    MpscQueue()
+    {
+        auto stub = new Node();
+        stub->next.store(nullptr, std::memory_order_relaxed);
+        this->_head.store(stub, std::memory_order_relaxed);
+        this->_tail = stub;
+    }
+
+    virtual ~MpscQueue()
+    {
+        T value;
+        while (this->pop(value)) { }
+        delete this->_tail;
+    }
+
+    void push(T value)
+    {
+        auto node = new Node();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+
+        auto previous = this->_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Only call this from the consumer thread
+    bool pop(T& value)
+    {
+        auto next = this->_tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) return false;
+
+        value = std::move(next->value);
+        delete this->_tail;
+        this->_tail = next;
+
+        return true;
+    }
+};
+
+// When STB image is included, we can load images asynchronously trough this library. Images are
+// decoded on the threads of a pool and uploaded through a pixel buffer object on the GL thread by
+// update(), which stops once the frame's byte or time budget is spent. Until then the texture shows a
+// grey placeholder. The mip chain is built on the pool as well and uploaded into immutable storage, which
+// means the texture gets a new name once it is ready. Keep the texture alive until its future is ready.
+#ifdef STBI_INCLUDE_STB_IMAGE_H
+class AsyncTextureLoader
+{
+    struct Decoded
+    {
+        Texture* texture;
+        std::string name;
+        bool loaded;
+        MipChain chain;
+        std::shared_ptr<std::promise<bool>> promise;
+    };
+
+    ThreadPool& _pool;
+    MipmapGenerator _generator;
+    MipFilter _filter;
+    bool _srgb;
+    MpscQueue<Decoded> _decoded;
+    GLuint _pixelBufferId;
+    std::atomic<int> _pending;
+    int _decoding;
+    std::mutex _decodingMutex;
+    std::condition_variable _decodingDone;
+
+    std::shared_future<bool> start(Texture* texture, const std::string& name, std::function<unsigned char*(int&, int&)> decode)
+    {
+        // A fresh name, the placeholder can not be specified over immutable storage
+        texture->cleanup();
+        texture->setup();
+
+        const unsigned char placeholder[] = { 128, 128, 128, 255 };
+        texture->use();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        texture->setSize(1, 1);
+
+        auto promise = std::make_shared<std::promise<bool>>();
+        std::shared_future<bool> future = promise->get_future().share();
+
+        this->_pending++;
+        {
+            std::lock_guard<std::mutex> lock(this->_decodingMutex);
+            this->_decoding++;
+        }
+        this->_pool.enqueue([this, texture, name, decode, promise] ()
+        {
+            Decoded decoded = { texture, name, false, MipChain(), promise };
+            int width = 0, height = 0;
+            auto pixels = decode(width, height);
+            if (pixels != nullptr)
+            {
+                this->_generator.generate(pixels, width, height, decoded.chain, this->_filter, this->_srgb);
+                decoded.loaded = true;
+                free(pixels);
+            }
+            this->_decoded.push(std::move(decoded));
+
+            // Notified under the lock, so the destructor can not return before the task let go of this
+            std::lock_guard<std::mutex> lock(this->_decodingMutex);
+            this->_decoding--;
+            this->_decodingDone.notify_all();
+        });
+
+        return future;
+    }
+
+public:
+    AsyncTextureLoader(ThreadPool& pool, MipFilter filter = MipFilter::Box, bool srgb = true)
+        : _pool(pool), _filter(filter), _srgb(srgb), _pixelBufferId(0), _pending(0), _decoding(0) { }
+
+    // Waits for the images still being decoded, the ones that were not uploaded resolve to false
+    virtual ~AsyncTextureLoader()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->_decodingMutex);
+            this->_decodingDone.wait(lock, [this] () { return this->_decoding == 0; });
+        }
+
+        Decoded decoded;
+        while (this->_decoded.pop(decoded))
+        {
+            this->_pending--;
+            decoded.promise->set_value(false);
+        }
+    }
+
+    int pending() const { return this->_pending; }
+
+    std::shared_future<bool> load(Texture* texture, const std::string& filename)
+    {
+        return this->start(texture, filename, [filename] (int& x, int& y)
+        {
+            int comp = 4;
+            return stbi_load(filename.c_str(), &x, &y, &comp, 4);
+        });
+    }
+
+    std::shared_future<bool> load(Texture* texture, const std::vector<unsigned char>& buffer)
+    {
+        auto data = std::make_shared<std::vector<unsigned char>>(buffer);
+        return this->start(texture, "memory", [data] (int& x, int& y)
+        {
+            int comp = 4;
+            return stbi_load_from_memory(data->data(), int(data->size()), &x, &y, &comp, 4);
+        });
+    }
+
+    // Uploads decoded images until byteBudget bytes or timeBudget milliseconds are spent, at least one
+    // image is uploaded per call. Call this once per frame on the GL thread.
+    void update(size_t byteBudget = 16 * 1024 * 1024, double timeBudget = 2.0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t uploaded = 0;
+
+        Decoded decoded;
+        while (this->_decoded.pop(decoded))
+        {
+            this->_pending--;
+            if (!decoded.loaded)
+            {
+                std::cout << "Unable to load " << decoded.name << std::endl;
+                decoded.promise->set_value(false);
+            }
+            else
+            {
+                auto size = decoded.chain.size();
+
+                if (this->_pixelBufferId == 0) glGenBuffers(1, &this->_pixelBufferId);
+                GLState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, this->_pixelBufferId);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);
+                auto target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                if (target != nullptr)
+                {
+                    auto bytes = static_cast<unsigned char*>(target);
+                    for (auto& level : decoded.chain.levels)
+                    {
+                        std::memcpy(bytes, level.pixels.data(), level.pixels.size());
+                        bytes += level.pixels.size();
+                    }
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                }
+                else
+                {
+                    GLState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                }
+
+                // Immutable storage can not be respecified over the placeholder
+                decoded.texture->cleanup();
+                decoded.texture->setup();
+                decoded.texture->use();
+                MipmapGenerator::upload(decoded.chain, target != nullptr);
+                GLState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                decoded.texture->setSize(decoded.chain.levels[0].width, decoded.chain.levels[0].height);
+
+                decoded.promise->set_value(true);
+                uploaded += size;
+            }
+
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (uploaded >= byteBudget || elapsed >= timeBudget) break;
+        }
+    }
+
+    void cleanup()
+    {
+        if (this->_pixelBufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_pixelBufferId);
+            this->_pixelBufferId = 0;
+        }
+    }
+};
+#endif // STBI_INCLUDE_STB_IMAGE_H
+
+#endif // GL_UTILITIES_ASYNCLOADERS_H
@@ -0,0 +1,317 @@
+#ifndef GL_UTILITIES_ATLAS_H
+#define GL_UTILITIES_ATLAS_H
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.state.h"
+#include "gl.utilities.textures.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Skyline bottom-left bin packer. Rectangles are placed on the lowest free segment of the skyline
+// where they fit, which keeps the packing tight enough for glyphs and sprites and supports inserting
+// at any time.
+class SkylinePacker
+{
+    struct Node
+    {
+        int x;
+        int y;
+        int width;
+    };
+
+    int _width;
+    int _height;
+    std::vector<Node> _nodes;
+
+    int fit(size_t index, int width, int height) const
+    {
+        if (this->_nodes[index].x + width > this->_width) return -1;
+
+        int y = 0;
+        for (auto i = index, remaining = size_t(width); remaining > 0; i++)
+        {
+            if (i >= this->_nodes.size()) return -1;
+            y = this->_nodes[i].y > y ? this->_nodes[i].y : y;
+            if (y + height > this->_height) return -1;
+            remaining -= size_t(this->_nodes[i].width) < remaining ? size_t(this->_nodes[i].width) : remaining;
+        }
+
+        return y;
+    }
+
+public:
+    SkylinePacker() : _width(0), _height(0) { }
+
+    void setup(int width, int height)
+    {
+        this->_width = width;
+        this->_height = height;
+        this->_nodes.assign(1, { 0, 0, width });
+    }
+
+    bool insert(int width, int height, int& x, int& y)
+    {
+        if (width <= 0 || height <= 0) return false;
+
+        size_t best = this->_nodes.size();
+        int bestTop = this->_height + 1, bestWidth = this->_width + 1;
+        for (size_t i = 0; i < this->_nodes.size(); i++)
+        {
+            auto top = this->fit(i, width, height);
+            if (top < 0) continue;
+
+            if (top + height < bestTop || (top + height == bestTop && this->_nodes[i].width < bestWidth))
+            {
+                best = i;
+                bestTop = top + height;
+                bestWidth = this->_nodes[i].width;
+            }
+        }
+
+        if (best == this->_nodes.size()) return false;
+
+        x = this->_nodes[best].x;
+        y = bestTop - height;
+        this->_nodes.insert(this->_nodes.begin() + long(best), { x, bestTop, width });
+
+        // Cut the segments the new one covers
+        for (auto i = best + 1; i < this->_nodes.size();)
+        {
+            auto& previous = this->_nodes[i - 1];
+            auto& node = this->_nodes[i];
+            if (node.x >= previous.x + previous.width) break;
+
+            auto shrink = previous.x + previous.width - node.x;
+            node.x += shrink;
+            node.width -= shrink;
+            if (node.width > 0) break;
+            this->_nodes.erase(this->_nodes.begin() + long(i));
+        }
+
+        for (size_t i = 0; i + 1 < this->_nodes.size();)
+        {
+            if (this->_nodes[i].y == this->_nodes[i + 1].y)
+            {
+                this->_nodes[i].width += this->_nodes[i + 1].width;
+                this->_nodes.erase(this->_nodes.begin() + long(i + 1));
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        return true;
+    }
+};
+
+struct AtlasRegion
+{
+    int layer;
+    int x;
+    int y;
+    int width;
+    int height;
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+};
+
+// Packs many small RGBA images into one GL_TEXTURE_2D, or into the layers of a GL_TEXTURE_2D_ARRAY,
+// so they can be drawn without rebinding. Every image is surrounded by a gutter of repeated edge
+// pixels and placed on a multiple of the coarsest mip level, which keeps neighbours from bleeding in
+// at the mip levels the gutter covers. Images can be added at any time, call update() before drawing
+// to rebuild the mip levels.
+class TextureAtlas
+{
+    Texture _texture;
+    GLenum _target;
+    int _width;
+    int _height;
+    int _gutter;
+    int _alignment;
+    GLsizei _levels;
+    bool _dirty;
+    std::vector<SkylinePacker> _layers;
+    std::vector<unsigned char> _padded;
+
+    static int roundUp(int value, int alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+public:
+    TextureAtlas() : _target(GL_TEXTURE_2D), _width(0), _height(0), _gutter(0), _alignment(1), _levels(1), _dirty(false) { }
+    virtual ~TextureAtlas() { }
+
+    // With layers > 1 the atlas becomes a texture array and regions get a layer index
+    bool setup(int width, int height, int layers = 1, int gutter = 2, bool mipmaps = true)
+    {
+        this->_target = layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        this->_width = width;
+        this->_height = height;
+        this->_gutter = gutter;
+        this->_dirty = false;
+
+        // A gutter of n pixels protects the levels down to where it shrinks to one pixel
+        this->_levels = 1;
+        while (mipmaps && (1 << this->_levels) <= gutter && (width >> this->_levels) > 0 && (height >> this->_levels) > 0) this->_levels++;
+        this->_alignment = 1 << (this->_levels - 1);
+
+        this->_layers.resize(size_t(layers));
+        for (auto& layer : this->_layers) layer.setup(width, height);
+
+        this->_texture.cleanup();
+        this->_texture.setup();
+        this->_texture.setSize(width, height);
+        GLState::current().bindTexture(this->_target, this->_texture.id());
+        glTexParameteri(this->_target, GL_TEXTURE_MIN_FILTER, this->_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(this->_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(this->_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(this->_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(this->_target, GL_TEXTURE_MAX_LEVEL, this->_levels - 1);
+
+        if (Extensions::hasTextureStorage())
+        {
+            if (this->_target == GL_TEXTURE_2D) glTexStorage2D(GL_TEXTURE_2D, this->_levels, GL_RGBA8, width, height);
+            else glTexStorage3D(GL_TEXTURE_2D_ARRAY, this->_levels, GL_RGBA8, width, height, layers);
+        }
+        else
+        {
+            for (GLint level = 0; level < this->_levels; level++)
+            {
+                if (this->_target == GL_TEXTURE_2D) glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width >> level, height >> level, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                else glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width >> level, height >> level, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    bool add(const unsigned char* rgba, int width, int height, AtlasRegion& region)
+    {
+        // The gutter alone would still get packed, with no edge to extrude into it
+        if (width <= 0 || height <= 0)
+        {
+            std::cout << "Unable to add a " << width << "x" << height << " image to the atlas" << std::endl;
+            return false;
+        }
+
+        auto paddedWidth = width + 2 * this->_gutter, paddedHeight = height + 2 * this->_gutter;
+
+        int x = 0, y = 0, layer = 0;
+        for (; layer < int(this->_layers.size()); layer++)
+        {
+            auto& packer = this->_layers[size_t(layer)];
+            if (packer.insert(roundUp(paddedWidth, this->_alignment), roundUp(paddedHeight, this->_alignment), x, y)) break;
+        }
+
+        if (layer == int(this->_layers.size()))
+        {
+            std::cout << "Atlas is full, unable to add a " << width << "x" << height << " image" << std::endl;
+            return false;
+        }
+
+        // Extrude the edges into the gutter
+        this->_padded.resize(size_t(paddedWidth) * size_t(paddedHeight) * 4);
+        for (int py = 0; py < paddedHeight; py++)
+        {
+            auto sy = py - this->_gutter;
+            sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+            for (int px = 0; px < paddedWidth; px++)
+            {
+                auto sx = px - this->_gutter;
+                sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+                std::memcpy(&this->_padded[(size_t(py) * size_t(paddedWidth) + size_t(px)) * 4], &rgba[(size_t(sy) * size_t(width) + size_t(sx)) * 4], 4);
+            }
+        }
+
+        GLState::current().bindTexture(this->_target, this->_texture.id());
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (this->_target == GL_TEXTURE_2D) glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, paddedWidth, paddedHeight, GL_RGBA, GL_UNSIGNED_BYTE, this->_padded.data());
+        else glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, paddedWidth, paddedHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, this->_padded.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        this->_dirty = this->_levels > 1;
+
+        region.layer = layer;
+        region.x = x + this->_gutter;
+        region.y = y + this->_gutter;
+        region.width = width;
+        region.height = height;
+        region.u0 = float(region.x) / float(this->_width);
+        region.v0 = float(region.y) / float(this->_height);
+        region.u1 = float(region.x + width) / float(this->_width);
+        region.v1 = float(region.y + height) / float(this->_height);
+
+        return true;
+    }
+
+// When STB image is included, the same sources as TextureLoader can be added
+#ifdef STBI_INCLUDE_STB_IMAGE_H
+    bool add(const std::string& filename, AtlasRegion& region)
+    {
+        int x = 0, y = 0, comp = 4;
+        auto imageData = stbi_load(filename.c_str(), &x, &y, &comp, 4);
+        if (imageData == nullptr)
+        {
+            std::cout << "Unable to load " << filename << std::endl;
+            return false;
+        }
+
+        auto result = this->add(imageData, x, y, region);
+        free(imageData);
+
+        return result;
+    }
+
+    bool add(const std::vector<unsigned char>& buffer, AtlasRegion& region)
+    {
+        int x = 0, y = 0, comp = 4;
+        auto imageData = stbi_load_from_memory(buffer.data(), int(buffer.size()), &x, &y, &comp, 4);
+        if (imageData == nullptr)
+        {
+            std::cout << "Unable to load texture from memory" << std::endl;
+            return false;
+        }
+
+        auto result = this->add(imageData, x, y, region);
+        free(imageData);
+
+        return result;
+    }
+#endif // STBI_INCLUDE_STB_IMAGE_H
+
+    // Rebuilds the mip levels after images were added
+    void update()
+    {
+        if (!this->_dirty) return;
+
+        GLState::current().bindTexture(this->_target, this->_texture.id());
+        glGenerateMipmap(this->_target);
+        this->_dirty = false;
+    }
+
+    void use(int unit = 0) const
+    {
+        GLState::current().bindTexture(this->_target, this->_texture.id(), unit);
+    }
+
+    void cleanup()
+    {
+        this->_texture.cleanup();
+        this->_layers.clear();
+    }
+
+    // Only a GL_TEXTURE_2D atlas can be drawn as a regular texture, for example through the RenderQueue
+    const Texture& texture() const { return this->_texture; }
+    GLenum target() const { return this->_target; }
+    int layers() const { return int(this->_layers.size()); }
+};
+
+#endif // GL_UTILITIES_ATLAS_H
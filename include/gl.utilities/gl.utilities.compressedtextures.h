@@ -0,0 +1,276 @@
+#ifndef GL_UTILITIES_COMPRESSEDTEXTURES_H
+#define GL_UTILITIES_COMPRESSEDTEXTURES_H
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.mappedfile.h"
+#include "gl.utilities.textures.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Loads BCn, ETC2 and ASTC textures from KTX, KTX2 and DDS containers. The file is memory mapped and
+// the levels are handed to glCompressedTexSubImage2D straight from the mapping, nothing is decoded or
+// copied on the CPU. Only 2D textures without supercompression are supported, whether the GPU can
+// sample the format is up to the driver.
+class CompressedTextureLoader
+{
+public:
+    struct Level
+    {
+        const unsigned char* data;
+        size_t size;
+        int width;
+        int height;
+    };
+
+    struct Image
+    {
+        GLenum format;
+        int width;
+        int height;
+        std::vector<Level> levels;
+    };
+
+private:
+    // The GL tokens are spelled out, GLES headers do not define most of them
+    static GLenum fromVkFormat(uint32_t format)
+    {
+        static const GLenum bc[] = {
+            0x83F0, 0x8C4C, 0x83F1, 0x8C4D,         // BC1 rgb, rgba
+            0x83F2, 0x8C4E, 0x83F3, 0x8C4F,         // BC2, BC3
+            0x8DBB, 0x8DBC, 0x8DBD, 0x8DBE,         // BC4, BC5
+            0x8E8F, 0x8E8E, 0x8E8C, 0x8E8D,         // BC6H, BC7
+            0x9274, 0x9275, 0x9276, 0x9277,         // ETC2 rgb, rgb a1
+            0x9278, 0x9279,                         // ETC2 rgba
+            0x9270, 0x9271, 0x9272, 0x9273,         // EAC r11, rg11
+        };
+
+        if (format >= 131 && format <= 156) return bc[format - 131];
+        if (format >= 157 && format <= 184) return ((format - 157) % 2 == 0 ? 0x93B0 : 0x93D0) + (format - 157) / 2;
+        return 0;
+    }
+
+    static GLenum fromDxgiFormat(uint32_t format)
+    {
+        switch (format)
+        {
+            case 71: return 0x83F1;
+            case 72: return 0x8C4D;
+            case 74: return 0x83F2;
+            case 75: return 0x8C4E;
+            case 77: return 0x83F3;
+            case 78: return 0x8C4F;
+            case 80: return 0x8DBB;
+            case 81: return 0x8DBC;
+            case 83: return 0x8DBD;
+            case 84: return 0x8DBE;
+            case 95: return 0x8E8F;
+            case 96: return 0x8E8E;
+            case 98: return 0x8E8C;
+            case 99: return 0x8E8D;
+        }
+        return 0;
+    }
+
+    static uint32_t read32(const unsigned char* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint64_t read64(const unsigned char* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static int mipSize(int size, size_t level)
+    {
+        size >>= level;
+        return size > 0 ? size : 1;
+    }
+
+    static bool parseKtx(const unsigned char* data, size_t size, Image& image)
+    {
+        if (size < 64 || read32(data + 12) != 0x04030201 || read32(data + 16) != 0)
+        {
+            std::cout << "KTX texture is not compressed or not little endian" << std::endl;
+            return false;
+        }
+        if (read32(data + 44) > 1 || read32(data + 48) > 1 || read32(data + 52) != 1)
+        {
+            std::cout << "KTX texture is not a 2D texture" << std::endl;
+            return false;
+        }
+
+        image.format = read32(data + 28);
+        image.width = int(read32(data + 36));
+        image.height = int(read32(data + 40));
+        auto levelCount = read32(data + 56) > 0 ? read32(data + 56) : 1;
+
+        auto offset = size_t(64) + read32(data + 60);
+        for (size_t level = 0; level < levelCount; level++)
+        {
+            if (offset + 4 > size) return false;
+            auto imageSize = size_t(read32(data + offset));
+            offset += 4;
+            if (offset + imageSize > size) return false;
+
+            image.levels.push_back({ data + offset, imageSize, mipSize(image.width, level), mipSize(image.height, level) });
+            offset += (imageSize + 3) & ~size_t(3);
+        }
+
+        return true;
+    }
+
+    static bool parseKtx2(const unsigned char* data, size_t size, Image& image)
+    {
+        if (size < 80) return false;
+        if (read32(data + 44) != 0)
+        {
+            std::cout << "KTX2 supercompression is not supported" << std::endl;
+            return false;
+        }
+        if (read32(data + 28) > 1 || read32(data + 32) > 1 || read32(data + 36) != 1)
+        {
+            std::cout << "KTX2 texture is not a 2D texture" << std::endl;
+            return false;
+        }
+
+        image.format = fromVkFormat(read32(data + 12));
+        image.width = int(read32(data + 20));
+        image.height = int(read32(data + 24));
+        auto levelCount = read32(data + 40) > 0 ? read32(data + 40) : 1;
+        if (size < 80 + size_t(levelCount) * 24) return false;
+
+        for (size_t level = 0; level < levelCount; level++)
+        {
+            auto offset = read64(data + 80 + level * 24);
+            auto length = read64(data + 80 + level * 24 + 8);
+            if (offset > size || length > size - offset) return false;
+
+            image.levels.push_back({ data + offset, size_t(length), mipSize(image.width, level), mipSize(image.height, level) });
+        }
+
+        return true;
+    }
+
+    static bool parseDds(const unsigned char* data, size_t size, Image& image)
+    {
+        if (size < 128) return false;
+
+        size_t offset = 128;
+        if (std::memcmp(data + 84, "DX10", 4) == 0)
+        {
+            if (size < 148) return false;
+            image.format = fromDxgiFormat(read32(data + 128));
+            offset = 148;
+        }
+        else if (std::memcmp(data + 84, "DXT1", 4) == 0) image.format = 0x83F1;
+        else if (std::memcmp(data + 84, "DXT3", 4) == 0) image.format = 0x83F2;
+        else if (std::memcmp(data + 84, "DXT5", 4) == 0) image.format = 0x83F3;
+        else if (std::memcmp(data + 84, "ATI1", 4) == 0 || std::memcmp(data + 84, "BC4U", 4) == 0) image.format = 0x8DBB;
+        else if (std::memcmp(data + 84, "ATI2", 4) == 0 || std::memcmp(data + 84, "BC5U", 4) == 0) image.format = 0x8DBD;
+        else image.format = 0;
+
+        // BC1 and BC4 use 8 bytes per 4x4 block, the others 16
+        auto blockSize = size_t(16);
+        if (image.format == 0x83F0 || image.format == 0x83F1 || image.format == 0x8C4C || image.format == 0x8C4D ||
+            image.format == 0x8DBB || image.format == 0x8DBC) blockSize = 8;
+
+        image.height = int(read32(data + 12));
+        image.width = int(read32(data + 16));
+        auto levelCount = read32(data + 28) > 0 ? read32(data + 28) : 1;
+
+        for (size_t level = 0; level < levelCount; level++)
+        {
+            auto width = mipSize(image.width, level), height = mipSize(image.height, level);
+            auto imageSize = size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockSize;
+            if (offset + imageSize > size) return false;
+
+            image.levels.push_back({ data + offset, imageSize, width, height });
+            offset += imageSize;
+        }
+
+        return true;
+    }
+
+public:
+    // Finds the levels in a KTX, KTX2 or DDS file, the level data points into the given memory
+    static bool parse(const unsigned char* data, size_t size, Image& image)
+    {
+        static const unsigned char ktx[] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+        static const unsigned char ktx2[] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+        image.levels.clear();
+        auto result = false;
+        if (size >= 12 && std::memcmp(data, ktx, 12) == 0) result = parseKtx(data, size, image);
+        else if (size >= 12 && std::memcmp(data, ktx2, 12) == 0) result = parseKtx2(data, size, image);
+        else if (size >= 4 && std::memcmp(data, "DDS ", 4) == 0) result = parseDds(data, size, image);
+
+        if (result && image.format == 0)
+        {
+            std::cout << "Compressed texture format is not supported" << std::endl;
+            return false;
+        }
+
+        return result && !image.levels.empty() && image.width > 0 && image.height > 0;
+    }
+
+    bool execute(Texture* texture, const unsigned char* data, size_t size)
+    {
+        Image image;
+        if (!parse(data, size, image))
+        {
+            std::cout << "Unable to load compressed texture" << std::endl;
+            return false;
+        }
+
+        if (texture->id() == 0) texture->setup();
+        texture->use();
+
+        auto levels = GLsizei(image.levels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        auto immutable = Extensions::hasTextureStorage();
+        if (immutable) glTexStorage2D(GL_TEXTURE_2D, levels, image.format, image.width, image.height);
+
+        for (GLint level = 0; level < levels; level++)
+        {
+            auto& mip = image.levels[size_t(level)];
+            if (immutable) glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, mip.width, mip.height, image.format, GLsizei(mip.size), mip.data);
+            else glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, mip.width, mip.height, 0, GLsizei(mip.size), mip.data);
+        }
+
+        if (glGetError() != GL_NO_ERROR)
+        {
+            std::cout << "Unable to upload compressed texture, format 0x" << std::hex << image.format << std::dec << " is probably not supported" << std::endl;
+            return false;
+        }
+
+        texture->setSize(image.width, image.height);
+        return true;
+    }
+
+    bool execute(Texture* texture, const std::string& filename)
+    {
+        MappedFile file;
+        if (!file.open(filename)) return false;
+
+        if (!this->execute(texture, file.data(), file.size()))
+        {
+            std::cout << "Unable to load " << filename << std::endl;
+            return false;
+        }
+
+        std::cout << "loaded " << filename << std::endl;
+        return true;
+    }
+};
+
+#endif // GL_UTILITIES_COMPRESSEDTEXTURES_H
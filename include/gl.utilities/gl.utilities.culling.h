@@ -0,0 +1,188 @@
+#ifndef GL_UTILITIES_CULLING_H
+#define GL_UTILITIES_CULLING_H
+
+#include "gl.utilities.simd.h"
+#include "gl.utilities.threadpool.h"
+#include "gl.utilities.vertexbuffers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Tests the bounds of many objects against the frustum of a camera. The world space boxes and spheres
+// are kept as separate arrays per component (padded to a multiple of four), so four objects are tested
+// against a plane at once. An object is culled when its box or its sphere lies completely outside one
+// of the six planes. Objects without bounds are never culled.
+class FrustumCuller
+{
+    static const size_t Grain = 1024;
+
+    std::vector<float> _localCenterX, _localCenterY, _localCenterZ;
+    std::vector<float> _localExtentX, _localExtentY, _localExtentZ;
+    std::vector<float> _localRadius;
+    std::vector<float> _centerX, _centerY, _centerZ;
+    std::vector<float> _extentX, _extentY, _extentZ;
+    std::vector<float> _radius;
+    std::vector<uint8_t> _visibility;
+    size_t _count;
+
+    void grow()
+    {
+        auto padded = (this->_count + 3) / 4 * 4;
+        for (auto array : {
+                 &this->_localCenterX, &this->_localCenterY, &this->_localCenterZ,
+                 &this->_localExtentX, &this->_localExtentY, &this->_localExtentZ, &this->_localRadius,
+                 &this->_centerX, &this->_centerY, &this->_centerZ,
+                 &this->_extentX, &this->_extentY, &this->_extentZ, &this->_radius })
+        {
+            array->resize(padded, 0.0f);
+        }
+        this->_visibility.resize(padded, 0);
+    }
+
+    // Extracts the planes of a column major view projection matrix (Gribb and Hartmann), normalized
+    // so the sphere test measures real distances
+    static void extractPlanes(const float m[], float planes[6][4])
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                planes[i * 2][c] = m[c * 4 + 3] + m[c * 4 + i];
+                planes[i * 2 + 1][c] = m[c * 4 + 3] - m[c * 4 + i];
+            }
+        }
+
+        for (int p = 0; p < 6; p++)
+        {
+            auto length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+            if (length > 0.0f) for (int c = 0; c < 4; c++) planes[p][c] /= length;
+        }
+    }
+
+    void cullRange(const float planes[6][4], size_t begin, size_t end)
+    {
+        const auto zero = simdSet1(0.0f);
+        for (auto i = begin; i < end; i += 4)
+        {
+            auto cx = simdLoad(&this->_centerX[i]), cy = simdLoad(&this->_centerY[i]), cz = simdLoad(&this->_centerZ[i]);
+            auto ex = simdLoad(&this->_extentX[i]), ey = simdLoad(&this->_extentY[i]), ez = simdLoad(&this->_extentZ[i]);
+            auto radius = simdLoad(&this->_radius[i]);
+
+            int outside = 0;
+            for (int p = 0; p < 6; p++)
+            {
+                auto distance = simdMulAdd(simdSet1(planes[p][0]), cx, simdMulAdd(simdSet1(planes[p][1]), cy, simdMulAdd(simdSet1(planes[p][2]), cz, simdSet1(planes[p][3]))));
+                auto reach = simdMulAdd(simdSet1(std::fabs(planes[p][0])), ex, simdMulAdd(simdSet1(std::fabs(planes[p][1])), ey, simdMul(simdSet1(std::fabs(planes[p][2])), ez)));
+                outside |= simdMaskLessThan(simdAdd(distance, simdMin(reach, radius)), zero);
+            }
+
+            for (size_t lane = 0; lane < 4; lane++) this->_visibility[i + lane] = (outside & (1 << lane)) == 0 ? 1 : 0;
+        }
+    }
+
+public:
+    typedef size_t Handle;
+
+    FrustumCuller() : _count(0) { }
+    virtual ~FrustumCuller() { }
+
+    // Adds an object with the given object space box, the sphere is centered on the box
+    Handle add(const float boundsMin[], const float boundsMax[], float radius, const float model[])
+    {
+        auto handle = this->_count++;
+        this->grow();
+
+        this->_localCenterX[handle] = (boundsMin[0] + boundsMax[0]) * 0.5f;
+        this->_localCenterY[handle] = (boundsMin[1] + boundsMax[1]) * 0.5f;
+        this->_localCenterZ[handle] = (boundsMin[2] + boundsMax[2]) * 0.5f;
+        this->_localExtentX[handle] = (boundsMax[0] - boundsMin[0]) * 0.5f;
+        this->_localExtentY[handle] = (boundsMax[1] - boundsMin[1]) * 0.5f;
+        this->_localExtentZ[handle] = (boundsMax[2] - boundsMin[2]) * 0.5f;
+        this->_localRadius[handle] = radius;
+        this->update(handle, model);
+
+        return handle;
+    }
+
+    // Adds the bounds of a buffer that was set up, drawn with the given column major model matrix
+    Handle add(const RenderableBuffer& buffer, const float model[])
+    {
+        if (buffer.hasBounds()) return this->add(buffer.boundsMin(), buffer.boundsMax(), buffer.radius(), model);
+
+        const float infinity = std::numeric_limits<float>::infinity();
+        const float minimum[] = { -infinity, -infinity, -infinity }, maximum[] = { infinity, infinity, infinity };
+        return this->add(minimum, maximum, infinity, model);
+    }
+
+    // Moves the object, the box is transformed into the world space box around it
+    void update(Handle handle, const float model[])
+    {
+        auto lx = this->_localCenterX[handle], ly = this->_localCenterY[handle], lz = this->_localCenterZ[handle];
+        auto ex = this->_localExtentX[handle], ey = this->_localExtentY[handle], ez = this->_localExtentZ[handle];
+        if (std::isinf(this->_localRadius[handle]))
+        {
+            this->_centerX[handle] = this->_centerY[handle] = this->_centerZ[handle] = 0.0f;
+            this->_extentX[handle] = this->_extentY[handle] = this->_extentZ[handle] = this->_radius[handle] = this->_localRadius[handle];
+            return;
+        }
+
+        this->_centerX[handle] = model[0] * lx + model[4] * ly + model[8] * lz + model[12];
+        this->_centerY[handle] = model[1] * lx + model[5] * ly + model[9] * lz + model[13];
+        this->_centerZ[handle] = model[2] * lx + model[6] * ly + model[10] * lz + model[14];
+        this->_extentX[handle] = std::fabs(model[0]) * ex + std::fabs(model[4]) * ey + std::fabs(model[8]) * ez;
+        this->_extentY[handle] = std::fabs(model[1]) * ex + std::fabs(model[5]) * ey + std::fabs(model[9]) * ez;
+        this->_extentZ[handle] = std::fabs(model[2]) * ex + std::fabs(model[6]) * ey + std::fabs(model[10]) * ez;
+
+        float scale = 0.0f;
+        for (int c = 0; c < 3; c++) scale = std::max(scale, model[c * 4] * model[c * 4] + model[c * 4 + 1] * model[c * 4 + 1] + model[c * 4 + 2] * model[c * 4 + 2]);
+        this->_radius[handle] = this->_localRadius[handle] * std::sqrt(scale);
+    }
+
+    void clear()
+    {
+        this->_count = 0;
+        this->grow();
+    }
+
+    size_t size() const { return this->_count; }
+
+    // The world space box of an object as it was tested last
+    void bounds(Handle handle, float boundsMin[], float boundsMax[]) const
+    {
+        boundsMin[0] = this->_centerX[handle] - this->_extentX[handle];
+        boundsMin[1] = this->_centerY[handle] - this->_extentY[handle];
+        boundsMin[2] = this->_centerZ[handle] - this->_extentZ[handle];
+        boundsMax[0] = this->_centerX[handle] + this->_extentX[handle];
+        boundsMax[1] = this->_centerY[handle] + this->_extentY[handle];
+        boundsMax[2] = this->_centerZ[handle] + this->_extentZ[handle];
+    }
+
+    // Fills visible with the handles of the objects inside the frustum of the column major view
+    // projection matrix, in the order they were added. Large sets are split over the pool.
+    void cull(const float viewProjection[], std::vector<Handle>& visible, ThreadPool* pool = nullptr)
+    {
+        float planes[6][4];
+        extractPlanes(viewProjection, planes);
+
+        auto padded = this->_visibility.size();
+        if (pool != nullptr)
+        {
+            pool->parallelFor(padded / 4, Grain / 4, [this, &planes] (size_t begin, size_t end) { this->cullRange(planes, begin * 4, end * 4); });
+        }
+        else
+        {
+            this->cullRange(planes, 0, padded);
+        }
+
+        visible.clear();
+        for (Handle i = 0; i < this->_count; i++)
+        {
+            if (this->_visibility[i] != 0) visible.push_back(i);
+        }
+    }
+};
+
+#endif // GL_UTILITIES_CULLING_H
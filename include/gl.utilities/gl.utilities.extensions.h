@@ -0,0 +1,101 @@
+#ifndef GL_UTILITIES_EXTENSIONS_H
+#define GL_UTILITIES_EXTENSIONS_H
+
+#ifdef _WIN32
+#include <glad/glad.h>
+#endif // _WIN32
+
+#ifdef __ANDROID__
+#include <GLES/gl.h>
+#include <GLES3/gl3.h>
+#endif // __ANDROID__
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Runtime queries on the context current on this thread. The version and extension list are read
+// once and cached, call invalidate() after making a different context current on the thread.
+class Extensions
+{
+    struct Capabilities
+    {
+        bool queried;
+        GLint major;
+        GLint minor;
+        std::vector<std::string> extensions;
+        bool textureStorage;
+        bool multiDrawIndirect;
+        bool bufferStorage;
+        bool parallelShaderCompile;
+    };
+
+    static Capabilities& cache()
+    {
+        static thread_local Capabilities capabilities = { false, 0, 0, { }, false, false, false, false };
+        return capabilities;
+    }
+
+    static bool listed(const Capabilities& capabilities, const char* name)
+    {
+        return std::binary_search(capabilities.extensions.begin(), capabilities.extensions.end(), std::string(name));
+    }
+
+    static const Capabilities& capabilities()
+    {
+        auto& capabilities = cache();
+        if (capabilities.queried) return capabilities;
+
+        glGetIntegerv(GL_MAJOR_VERSION, &capabilities.major);
+        glGetIntegerv(GL_MINOR_VERSION, &capabilities.minor);
+
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        capabilities.extensions.clear();
+        for (GLint i = 0; i < count; i++)
+        {
+            auto extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+            if (extension != nullptr) capabilities.extensions.push_back(extension);
+        }
+        std::sort(capabilities.extensions.begin(), capabilities.extensions.end());
+
+        auto version = [&capabilities] (GLint major, GLint minor) { return capabilities.major > major || (capabilities.major == major && capabilities.minor >= minor); };
+#ifdef __ANDROID__
+        capabilities.textureStorage = true;
+#else
+        capabilities.textureStorage = version(4, 2) || listed(capabilities, "GL_ARB_texture_storage");
+#endif // __ANDROID__
+        capabilities.multiDrawIndirect = version(4, 3) || listed(capabilities, "GL_ARB_multi_draw_indirect");
+        capabilities.bufferStorage = version(4, 4) || listed(capabilities, "GL_ARB_buffer_storage");
+        capabilities.parallelShaderCompile = listed(capabilities, "GL_KHR_parallel_shader_compile") || listed(capabilities, "GL_ARB_parallel_shader_compile");
+
+        // Without a current context there is nothing to cache yet
+        capabilities.queried = capabilities.major > 0;
+
+        return capabilities;
+    }
+
+public:
+    static void invalidate() { cache().queried = false; }
+
+    static bool hasVersion(int major, int minor)
+    {
+        auto& current = capabilities();
+        return current.major > major || (current.major == major && current.minor >= minor);
+    }
+
+    static bool hasExtension(const char* name) { return listed(capabilities(), name); }
+
+    // Immutable texture storage through glTexStorage2D
+    static bool hasTextureStorage() { return capabilities().textureStorage; }
+
+    // glMultiDrawElementsIndirect and glMultiDrawArraysIndirect
+    static bool hasMultiDrawIndirect() { return capabilities().multiDrawIndirect; }
+
+    // Persistently mapped buffers through glBufferStorage
+    static bool hasBufferStorage() { return capabilities().bufferStorage; }
+
+    static bool hasParallelShaderCompile() { return capabilities().parallelShaderCompile; }
+};
+
+#endif // GL_UTILITIES_EXTENSIONS_H
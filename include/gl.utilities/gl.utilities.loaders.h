@@ -1,12 +1,55 @@
 #ifndef GL_UTILITIES_LOADERS_H
 #define GL_UTILITIES_LOADERS_H
 
+#include "gl.utilities.mipmaps.h"
 #include "gl.utilities.textures.h"
 #include <cstdlib>
 
 class TextureLoader
 {
+    MipmapGenerator _generator;
+    bool _mipmaps;
+    MipFilter _filter;
+    bool _srgb;
+
+    void upload(Texture* texture, const unsigned char* imageData, int x, int y)
+    {
+        MipChain chain;
+        if (this->_mipmaps)
+        {
+            this->_generator.generate(imageData, x, y, chain, this->_filter, this->_srgb);
+        }
+        else
+        {
+            chain.levels.resize(1);
+            chain.levels[0].width = x;
+            chain.levels[0].height = y;
+            chain.levels[0].pixels.assign(imageData, imageData + size_t(x) * size_t(y) * 4);
+        }
+
+        // Immutable storage can not be respecified, loading into such a texture again needs a fresh name
+        GLint immutable = GL_FALSE;
+        if (texture->_textureId != 0 && Extensions::hasTextureStorage())
+        {
+            GLState::current().bindTexture(GL_TEXTURE_2D, texture->_textureId);
+            glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+        }
+        if (texture->_textureId == 0 || immutable == GL_TRUE)
+        {
+            texture->cleanup();
+            texture->setup();
+        }
+
+        texture->_width = x;
+        texture->_height = y;
+        GLState::current().bindTexture(GL_TEXTURE_2D, texture->_textureId);
+        MipmapGenerator::upload(chain);
+    }
+
 public:
+    TextureLoader(bool mipmaps = true, MipFilter filter = MipFilter::Box, bool srgb = true)
+        : _mipmaps(mipmaps), _filter(filter), _srgb(srgb) { }
+
 // When STB image is included, we can load images trough this library
 #ifdef STBI_INCLUDE_STB_IMAGE_H
     bool execute(Texture* texture, const std::string& filename)
@@ -15,14 +58,8 @@ public:
         auto imageData = stbi_load(filename.c_str(), &x, &y, &comp, 4);
         if (imageData != nullptr)
         {
-            texture->_width = x;
-            texture->_height = y;
             std::cout << "loaded " << filename << std::endl;
-            auto format = comp == 4 ? GL_RGBA : GL_RGB;
-            glBindTexture(GL_TEXTURE_2D, texture->_textureId);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, x, y, 0, format, GL_UNSIGNED_BYTE, imageData);
+            this->upload(texture, imageData, x, y);
             free(imageData);
 
             return true;
@@ -38,13 +75,7 @@ public:
         auto imageData = stbi_load_from_memory(buffer.data(), buffer.size(), &x, &y, &comp, 4);
         if (imageData != nullptr)
         {
-            texture->_width = x;
-            texture->_height = y;
-            auto format = comp == 4 ? GL_RGBA : GL_RGB;
-            glBindTexture(GL_TEXTURE_2D, texture->_textureId);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, x, y, 0, format, GL_UNSIGNED_BYTE, imageData);
+            this->upload(texture, imageData, x, y);
             free(imageData);
 
             return true;
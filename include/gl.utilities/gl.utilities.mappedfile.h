@@ -0,0 +1,115 @@
+#ifndef GL_UTILITIES_MAPPEDFILE_H
+#define GL_UTILITIES_MAPPEDFILE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Read only view of a whole file through the virtual memory system, the pages are only read from disk
+// when they are touched and can be handed to GL without copying them first
+class MappedFile
+{
+    const unsigned char* _data;
+    size_t _size;
+#ifdef _WIN32
+    HANDLE _file;
+    HANDLE _mapping;
+#endif // _WIN32
+
+public:
+    MappedFile() : _data(nullptr), _size(0)
+#ifdef _WIN32
+        , _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+#endif // _WIN32
+    { }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+    virtual ~MappedFile() { this->close(); }
+
+    bool open(const std::string& filename)
+    {
+        this->close();
+
+#ifdef _WIN32
+        this->_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (this->_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->_file, &size) || size.QuadPart == 0)
+        {
+            std::cout << "Unable to open " << filename << std::endl;
+            this->close();
+            return false;
+        }
+
+        this->_mapping = CreateFileMappingA(this->_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        auto view = this->_mapping != nullptr ? MapViewOfFile(this->_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr)
+        {
+            std::cout << "Unable to map " << filename << std::endl;
+            this->close();
+            return false;
+        }
+
+        this->_data = static_cast<const unsigned char*>(view);
+        this->_size = size_t(size.QuadPart);
+#else
+        auto file = ::open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if (file < 0 || fstat(file, &info) != 0 || info.st_size == 0)
+        {
+            std::cout << "Unable to open " << filename << std::endl;
+            if (file >= 0) ::close(file);
+            return false;
+        }
+
+        // The mapping keeps its own reference to the file
+        auto view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (view == MAP_FAILED)
+        {
+            std::cout << "Unable to map " << filename << std::endl;
+            return false;
+        }
+
+        this->_data = static_cast<const unsigned char*>(view);
+        this->_size = size_t(info.st_size);
+#endif // _WIN32
+
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (this->_data != nullptr) UnmapViewOfFile(this->_data);
+        if (this->_mapping != nullptr) CloseHandle(this->_mapping);
+        if (this->_file != INVALID_HANDLE_VALUE) CloseHandle(this->_file);
+        this->_mapping = nullptr;
+        this->_file = INVALID_HANDLE_VALUE;
+#else
+        if (this->_data != nullptr) munmap(const_cast<unsigned char*>(this->_data), this->_size);
+#endif // _WIN32
+        this->_data = nullptr;
+        this->_size = 0;
+    }
+
+    const unsigned char* data() const { return this->_data; }
+    size_t size() const { return this->_size; }
+    bool isOpen() const { return this->_data != nullptr; }
+};
+
+#endif // GL_UTILITIES_MAPPEDFILE_H
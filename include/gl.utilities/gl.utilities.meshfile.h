@@ -0,0 +1,328 @@
+#ifndef GL_UTILITIES_MESHFILE_H
+#define GL_UTILITIES_MESHFILE_H
+
+#include "gl.utilities.mappedfile.h"
+#include "gl.utilities.state.h"
+#include "gl.utilities.vertexbuffers.h"
+#include "gl.utilities.vertexlayout.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+
+struct MeshFileAttribute
+{
+    uint32_t components;
+    uint32_t type;
+    uint32_t normalized;
+    uint32_t integer;
+    uint32_t offset;
+};
+
+struct MeshFileHeader
+{
+    static const uint32_t Version = 3;
+    static const size_t MaxAttributes = 16;
+    static const size_t MaxLods = 16;
+
+    char magic[4];
+    uint32_t version;
+    uint32_t stride;
+    uint32_t attributeCount;
+    MeshFileAttribute attributes[MaxAttributes];
+    uint32_t drawMode;
+    uint32_t indexType;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t faceCount;
+    uint32_t lodCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t faceOffset;
+    uint32_t lodFirsts[MaxLods];
+    uint32_t lodCounts[MaxLods];
+    float lodErrors[MaxLods];
+    uint32_t bounded;
+    float boundsMin[3];
+    float boundsMax[3];
+    float center[3];
+    float radius;
+};
+
+// Binary container for a set up RenderableBuffer: the layout of the vertices, the interleaved vertex
+// blob as it lives in the GL buffer, the indices (with the simplified levels behind the full mesh), the
+// level of detail table, the bounds and the face ranges. Loading maps the file and hands
+// the blobs to glBufferData as they are, so nothing is parsed per vertex. The layout is checked
+// against the one the buffer is loaded with, the file uses the byte order of the machine it was
+// written on.
+class MeshFile
+{
+    static const size_t Alignment = 16;
+
+    template <class Layout, size_t... Indices>
+    static void describe(MeshFileHeader& header, std::index_sequence<Indices...>)
+    {
+        const MeshFileAttribute attributes[] = {
+            {
+                uint32_t(Layout::template attribute<Indices>::components),
+                uint32_t(Layout::template attribute<Indices>::type),
+                uint32_t(Layout::template attribute<Indices>::normalized),
+                uint32_t(Layout::template attribute<Indices>::integer),
+                uint32_t(Layout::offset(Indices)),
+            }...
+        };
+
+        header.stride = uint32_t(Layout::stride);
+        header.attributeCount = uint32_t(Layout::count);
+        std::memcpy(header.attributes, attributes, sizeof(attributes));
+    }
+
+    template <class Layout>
+    static void describe(MeshFileHeader& header)
+    {
+        static_assert(Layout::count <= MeshFileHeader::MaxAttributes, "Too many attributes for a mesh file");
+        std::memset(&header, 0, sizeof(header));
+        describe<Layout>(header, std::make_index_sequence<Layout::count>());
+    }
+
+    static size_t alignUp(size_t value)
+    {
+        return (value + Alignment - 1) / Alignment * Alignment;
+    }
+
+    static bool writeBuffer(FILE* file, GLuint buffer, size_t size)
+    {
+        if (size == 0) return true;
+
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        auto data = glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT);
+        if (data == nullptr) return false;
+
+        auto result = fwrite(data, 1, size, file) == size;
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+
+        return result;
+    }
+
+    static size_t indexSize(const MeshFileHeader& header)
+    {
+        if (header.indexType == 0) return 0;
+        return size_t(header.indexCount) * (header.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+    }
+
+    // Whether length bytes from offset lie within a file of the given size, without wrapping around
+    static bool fits(uint64_t offset, uint64_t length, size_t size)
+    {
+        return offset <= size && length <= size - offset;
+    }
+
+    static bool pad(FILE* file, size_t from, size_t to)
+    {
+        const char zeros[Alignment] = { 0 };
+        return to == from || fwrite(zeros, 1, to - from, file) == to - from;
+    }
+
+public:
+    // Writes the vertices as they were uploaded, Layout is the layout the buffer was set up with (the
+    // packed layout when it was set up with setupPacked)
+    template <class Layout>
+    static bool write(const RenderableBuffer& buffer, const std::string& filename)
+    {
+        MeshFileHeader header;
+        describe<Layout>(header);
+        std::memcpy(header.magic, "GLUM", 4);
+        header.version = MeshFileHeader::Version;
+        header.drawMode = buffer._drawMode;
+        header.indexType = buffer._indexType;
+        header.vertexCount = uint32_t(buffer._vertexCount);
+        header.indexCount = uint32_t(buffer._indexCount);
+        header.faceCount = uint32_t(buffer._faceFirsts.size());
+
+        if (buffer._lodCounts.size() > MeshFileHeader::MaxLods)
+        {
+            std::cout << "Unable to write " << filename << ", a mesh file holds up to " << MeshFileHeader::MaxLods << " levels of detail" << std::endl;
+            return false;
+        }
+        header.lodCount = uint32_t(buffer._lodCounts.size());
+        for (size_t i = 0; i < buffer._lodCounts.size(); i++)
+        {
+            header.lodFirsts[i] = uint32_t(reinterpret_cast<size_t>(buffer._lodOffsets[i]) / size_t(buffer.indexSize()));
+            header.lodCounts[i] = uint32_t(buffer._lodCounts[i]);
+            header.lodErrors[i] = buffer._lodErrors[i];
+            header.indexCount = std::max(header.indexCount, header.lodFirsts[i] + header.lodCounts[i]);
+        }
+
+        header.bounded = buffer._bounded ? 1 : 0;
+        std::copy(buffer._boundsMin, buffer._boundsMin + 3, header.boundsMin);
+        std::copy(buffer._boundsMax, buffer._boundsMax + 3, header.boundsMax);
+        std::copy(buffer._center, buffer._center + 3, header.center);
+        header.radius = buffer._radius;
+
+        auto vertexSize = size_t(header.vertexCount) * header.stride;
+        auto indexSize = header.indexType != 0 ? size_t(header.indexCount) * size_t(buffer.indexSize()) : 0;
+        header.vertexOffset = alignUp(sizeof(header));
+        header.indexOffset = alignUp(header.vertexOffset + vertexSize);
+        header.faceOffset = alignUp(header.indexOffset + indexSize);
+
+        auto file = fopen(filename.c_str(), "wb");
+        if (file == nullptr)
+        {
+            std::cout << "Unable to open " << filename << " for writing" << std::endl;
+            return false;
+        }
+
+        auto result = fwrite(&header, sizeof(header), 1, file) == 1;
+        result = result && pad(file, sizeof(header), size_t(header.vertexOffset));
+        result = result && writeBuffer(file, buffer._vertexBufferId, vertexSize);
+        result = result && pad(file, size_t(header.vertexOffset) + vertexSize, size_t(header.indexOffset));
+        result = result && writeBuffer(file, buffer._indexBufferId, indexSize);
+        result = result && pad(file, size_t(header.indexOffset) + indexSize, size_t(header.faceOffset));
+        for (size_t i = 0; result && i < buffer._faceFirsts.size(); i++)
+        {
+            int32_t face[] = { int32_t(buffer._faceFirsts[i]), int32_t(buffer._faceCounts[i]) };
+            result = fwrite(face, sizeof(face), 1, file) == 1;
+        }
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+        fclose(file);
+
+        if (!result) std::cout << "Unable to write " << filename << std::endl;
+        return result;
+    }
+
+    // Copies the header from the start of the file and checks it against Layout and the size of the
+    // file: the magic and version, the vertex layout, the index type, that every blob, level of detail
+    // and face lies within the file
+    template <class Layout>
+    static bool validate(const unsigned char* data, size_t size, MeshFileHeader& header, const std::string& filename)
+    {
+        MeshFileHeader expected;
+        describe<Layout>(expected);
+        if (size < sizeof(header))
+        {
+            std::cout << filename << " is not a mesh file" << std::endl;
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, "GLUM", 4) != 0 || header.version != MeshFileHeader::Version)
+        {
+            std::cout << filename << " is not a mesh file" << std::endl;
+            return false;
+        }
+        if (header.stride != expected.stride || header.attributeCount != expected.attributeCount ||
+            std::memcmp(header.attributes, expected.attributes, sizeof(header.attributes)) != 0)
+        {
+            std::cout << "The vertex layout of " << filename << " does not match" << std::endl;
+            return false;
+        }
+        if (header.indexType != 0 && header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT)
+        {
+            std::cout << "The index type of " << filename << " is not supported" << std::endl;
+            return false;
+        }
+
+        auto vertexSize = size_t(header.vertexCount) * header.stride;
+        auto indexSize = MeshFile::indexSize(header);
+        if (!fits(header.vertexOffset, vertexSize, size) || !fits(header.indexOffset, indexSize, size) ||
+            !fits(header.faceOffset, size_t(header.faceCount) * 2 * sizeof(int32_t), size))
+        {
+            std::cout << filename << " is truncated" << std::endl;
+            return false;
+        }
+        auto lodsValid = header.lodCount <= MeshFileHeader::MaxLods && (header.lodCount == 0 || indexSize != 0);
+        for (size_t i = 0; lodsValid && i < header.lodCount; i++)
+        {
+            lodsValid = size_t(header.lodFirsts[i]) + header.lodCounts[i] <= header.indexCount;
+        }
+        if (!lodsValid)
+        {
+            std::cout << "The levels of detail in " << filename << " are out of range" << std::endl;
+            return false;
+        }
+
+        // Faces index the indices, or the vertices when there are none
+        auto elementCount = int64_t(indexSize != 0 ? header.indexCount : header.vertexCount);
+        for (size_t i = 0; i < header.faceCount; i++)
+        {
+            int32_t face[2];
+            std::memcpy(face, data + header.faceOffset + i * sizeof(face), sizeof(face));
+            if (face[0] < 0 || face[1] < 0 || int64_t(face[0]) + face[1] > elementCount)
+            {
+                std::cout << "The faces in " << filename << " are out of range" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Replaces the contents of the buffer with the mesh in the file, the attributes are set up with the
+    // given shader
+    template <class Layout, class ShaderType>
+    static bool load(RenderableBuffer& buffer, const ShaderType& shader, const std::string& filename)
+    {
+        MappedFile file;
+        if (!file.open(filename)) return false;
+
+        MeshFileHeader header;
+        if (!validate<Layout>(file.data(), file.size(), header, filename)) return false;
+
+        auto vertexSize = size_t(header.vertexCount) * header.stride;
+        auto indexSize = MeshFile::indexSize(header);
+
+        buffer.cleanup();
+        if (!buffer.setupRenderableBuffer(int(header.vertexCount)))
+            return false;
+
+        GLState::current().bindVertexArray(buffer._vertexArrayId);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, buffer._vertexBufferId);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexSize), file.data() + header.vertexOffset, GL_STATIC_DRAW);
+
+        buffer._drawMode = header.drawMode;
+        buffer._indexed = indexSize != 0;
+        if (buffer._indexed)
+        {
+            glGenBuffers(1, &buffer._indexBufferId);
+            GLState::current().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer._indexBufferId);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexSize), file.data() + header.indexOffset, GL_STATIC_DRAW);
+            buffer._indexType = header.indexType;
+            buffer._indexCount = int(header.lodCount > 0 ? header.lodCounts[0] : header.indexCount);
+        }
+
+        for (size_t i = 0; i < header.lodCount; i++)
+        {
+            buffer._lodOffsets.push_back(reinterpret_cast<const GLvoid*>(size_t(header.lodFirsts[i]) * size_t(buffer.indexSize())));
+            buffer._lodCounts.push_back(GLsizei(header.lodCounts[i]));
+            buffer._lodErrors.push_back(header.lodErrors[i]);
+        }
+
+        buffer._bounded = header.bounded != 0;
+        std::copy(header.boundsMin, header.boundsMin + 3, buffer._boundsMin);
+        std::copy(header.boundsMax, header.boundsMax + 3, buffer._boundsMax);
+        std::copy(header.center, header.center + 3, buffer._center);
+        buffer._radius = header.radius;
+
+        buffer._faceFirsts.resize(header.faceCount);
+        buffer._faceCounts.resize(header.faceCount);
+        auto faces = file.data() + header.faceOffset;
+        for (size_t i = 0; i < header.faceCount; i++)
+        {
+            int32_t face[2];
+            std::memcpy(face, faces + i * sizeof(face), sizeof(face));
+            buffer._faceFirsts[i] = face[0];
+            buffer._faceCounts[i] = face[1];
+        }
+        buffer.setupFaces();
+
+        shader.template setupAttributes<Layout>();
+
+        GLState::current().bindVertexArray(0);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return true;
+    }
+};
+
+#endif // GL_UTILITIES_MESHFILE_H
@@ -0,0 +1,296 @@
+#ifndef GL_UTILITIES_MESHOPTIMIZER_H
+#define GL_UTILITIES_MESHOPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Reads the position of a vertex for the overdraw pass, only float positions with at least three
+// components in a member called pos are used
+template <class VertexType, class = void>
+struct VertexPosition
+{
+    static const float* get(const VertexType&) { return nullptr; }
+};
+
+template <class VertexType>
+struct VertexPosition<VertexType, typename std::enable_if<
+    std::is_same<typename decltype(std::declval<VertexType&>().pos)::value_type, float>::value &&
+    sizeof(std::declval<VertexType&>().pos) >= 3 * sizeof(float)>::type>
+{
+    static const float* get(const VertexType& vertex) { return reinterpret_cast<const float*>(&vertex.pos); }
+};
+
+struct MeshOptimizerStats
+{
+    float acmrBefore;
+    float acmrAfter;
+    float atvrBefore;
+    float atvrAfter;
+};
+
+// Reorders indexed triangle lists for the gpu. Triangles are ordered for the post transform vertex
+// cache with Tipsify (Sander, Nehab and Barczak 2007), whose clusters are then sorted from the outside
+// of the mesh inwards to reduce overdraw, and finally the vertices are renumbered in the order they
+// are first used so they are fetched sequentially. ACMR is the average number of vertices transformed
+// per triangle, ATVR the number transformed per unique vertex, both with a FIFO cache.
+class MeshOptimizer
+{
+    std::vector<unsigned int> _remap;
+    std::vector<unsigned int> _vertices;
+    std::vector<unsigned int> _local;
+    std::vector<unsigned int> _adjacencyOffsets;
+    std::vector<unsigned int> _adjacency;
+    std::vector<int> _live;
+    std::vector<int> _cacheTime;
+    std::vector<bool> _emitted;
+    std::vector<int> _deadEnd;
+    std::vector<int> _candidates;
+    std::vector<unsigned int> _output;
+    std::vector<size_t> _clusters;
+
+    int skipDeadEnd(int& cursor)
+    {
+        while (!this->_deadEnd.empty())
+        {
+            auto vertex = this->_deadEnd.back();
+            this->_deadEnd.pop_back();
+            if (this->_live[size_t(vertex)] > 0) return vertex;
+        }
+
+        for (; cursor < int(this->_live.size()); cursor++)
+        {
+            if (this->_live[size_t(cursor)] > 0) return cursor;
+        }
+
+        return -1;
+    }
+
+    // Tipsify on one range of triangles, the vertices are renumbered locally first so a range only
+    // costs as much as the vertices it uses. Cluster starts are collected in _clusters.
+    void tipsify(unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+    {
+        auto triangleCount = indexCount / 3;
+
+        if (this->_remap.size() < vertexCount) this->_remap.resize(vertexCount, ~0u);
+        this->_vertices.clear();
+        this->_local.resize(indexCount);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            auto& local = this->_remap[indices[i]];
+            if (local == ~0u)
+            {
+                local = unsigned(this->_vertices.size());
+                this->_vertices.push_back(indices[i]);
+            }
+            this->_local[i] = local;
+        }
+        auto count = this->_vertices.size();
+
+        this->_adjacencyOffsets.assign(count + 1, 0);
+        for (size_t i = 0; i < indexCount; i++) this->_adjacencyOffsets[this->_local[i] + 1]++;
+        for (size_t v = 0; v < count; v++) this->_adjacencyOffsets[v + 1] += this->_adjacencyOffsets[v];
+        this->_live.assign(count, 0);
+        this->_adjacency.resize(indexCount);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            auto v = this->_local[i];
+            this->_adjacency[this->_adjacencyOffsets[v] + unsigned(this->_live[v]++)] = unsigned(i / 3);
+        }
+
+        this->_cacheTime.assign(count, 0);
+        this->_emitted.assign(triangleCount, false);
+        this->_deadEnd.clear();
+        this->_output.clear();
+        this->_clusters.assign(1, 0);
+
+        int fanning = 0, cursor = 0, time = int(cacheSize) + 1;
+        while (fanning >= 0)
+        {
+            this->_candidates.clear();
+            for (auto a = this->_adjacencyOffsets[size_t(fanning)]; a < this->_adjacencyOffsets[size_t(fanning) + 1]; a++)
+            {
+                auto triangle = this->_adjacency[a];
+                if (this->_emitted[triangle]) continue;
+
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    auto v = int(this->_local[triangle * 3 + corner]);
+                    this->_output.push_back(this->_vertices[size_t(v)]);
+                    this->_deadEnd.push_back(v);
+                    this->_candidates.push_back(v);
+                    this->_live[size_t(v)]--;
+                    if (time - this->_cacheTime[size_t(v)] > int(cacheSize)) this->_cacheTime[size_t(v)] = time++;
+                }
+                this->_emitted[triangle] = true;
+            }
+
+            // Prefer the candidate that stays in the cache while its remaining triangles are emitted
+            int next = -1, best = -1;
+            for (auto v : this->_candidates)
+            {
+                if (this->_live[size_t(v)] <= 0) continue;
+
+                int priority = 0;
+                if (time - this->_cacheTime[size_t(v)] + 2 * this->_live[size_t(v)] <= int(cacheSize)) priority = time - this->_cacheTime[size_t(v)];
+                if (priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            if (next < 0)
+            {
+                next = this->skipDeadEnd(cursor);
+                if (next >= 0 && this->_output.size() / 3 > this->_clusters.back()) this->_clusters.push_back(this->_output.size() / 3);
+            }
+            fanning = next;
+        }
+
+        std::copy(this->_output.begin(), this->_output.end(), indices);
+        for (auto v : this->_vertices) this->_remap[v] = ~0u;
+    }
+
+    // Sorts the clusters of the last tipsify() on how much they face away from the center of the range
+    void sortClusters(unsigned int* indices, size_t indexCount, const float* const* positions)
+    {
+        auto clusterCount = this->_clusters.size();
+        if (clusterCount < 2) return;
+
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < indexCount; i++) for (int c = 0; c < 3; c++) center[c] += positions[indices[i]][c];
+        for (int c = 0; c < 3; c++) center[c] /= float(indexCount);
+
+        std::vector<std::pair<float, size_t>> order(clusterCount);
+        for (size_t cluster = 0; cluster < clusterCount; cluster++)
+        {
+            auto first = this->_clusters[cluster];
+            auto last = cluster + 1 < clusterCount ? this->_clusters[cluster + 1] : indexCount / 3;
+
+            float normal[3] = { 0.0f, 0.0f, 0.0f }, centroid[3] = { 0.0f, 0.0f, 0.0f }, area = 0.0f;
+            for (auto triangle = first; triangle < last; triangle++)
+            {
+                auto p0 = positions[indices[triangle * 3]], p1 = positions[indices[triangle * 3 + 1]], p2 = positions[indices[triangle * 3 + 2]];
+                float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                auto weight = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c < 3; c++)
+                {
+                    normal[c] += n[c];
+                    centroid[c] += (p0[c] + p1[c] + p2[c]) / 3.0f * weight;
+                }
+                area += weight;
+            }
+
+            float metric = 0.0f;
+            auto length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (area > 0.0f && length > 0.0f)
+            {
+                for (int c = 0; c < 3; c++) metric += (centroid[c] / area - center[c]) * normal[c] / length;
+            }
+            order[cluster] = std::make_pair(-metric, cluster);
+        }
+        std::stable_sort(order.begin(), order.end(), [] (const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first < b.first; });
+
+        this->_output.clear();
+        for (auto& entry : order)
+        {
+            auto first = this->_clusters[entry.second];
+            auto last = entry.second + 1 < clusterCount ? this->_clusters[entry.second + 1] : indexCount / 3;
+            this->_output.insert(this->_output.end(), indices + first * 3, indices + last * 3);
+        }
+        std::copy(this->_output.begin(), this->_output.end(), indices);
+    }
+
+public:
+    static const unsigned int DefaultCacheSize = 16;
+
+    static void analyze(const unsigned int* indices, size_t indexCount, size_t vertexCount, float& acmr, float& atvr, unsigned int cacheSize = DefaultCacheSize)
+    {
+        std::vector<unsigned int> cache(cacheSize, ~0u);
+        std::vector<bool> used(vertexCount, false);
+        size_t head = 0, misses = 0, unique = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            auto v = indices[i];
+            if (!used[v])
+            {
+                used[v] = true;
+                unique++;
+            }
+            if (std::find(cache.begin(), cache.end(), v) != cache.end()) continue;
+
+            cache[head] = v;
+            head = (head + 1) % cacheSize;
+            misses++;
+        }
+
+        acmr = indexCount >= 3 ? float(misses) / float(indexCount / 3) : 0.0f;
+        atvr = unique > 0 ? float(misses) / float(unique) : 0.0f;
+    }
+
+    // Reorders the triangles of one range for the vertex cache, and for overdraw when positions are given.
+    // Indices after the last whole triangle are left where they are.
+    void reorderTriangles(unsigned int* indices, size_t indexCount, size_t vertexCount, const float* const* positions = nullptr, unsigned int cacheSize = DefaultCacheSize)
+    {
+        indexCount -= indexCount % 3;
+        if (indexCount < 6) return;
+
+        this->tipsify(indices, indexCount, vertexCount, cacheSize);
+        if (positions != nullptr) this->sortClusters(indices, indexCount, positions);
+    }
+
+    // Renumbers the vertices in the order they are first used, unused vertices move to the end
+    template <class VertexType>
+    void reorderVertices(std::vector<VertexType>& verts, unsigned int* indices, size_t indexCount)
+    {
+        this->_remap.assign(verts.size(), ~0u);
+        unsigned int next = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            auto& target = this->_remap[indices[i]];
+            if (target == ~0u) target = next++;
+            indices[i] = target;
+        }
+        for (auto& target : this->_remap) if (target == ~0u) target = next++;
+
+        std::vector<VertexType> reordered(verts.size());
+        for (size_t v = 0; v < verts.size(); v++) reordered[this->_remap[v]] = verts[v];
+        verts.swap(reordered);
+
+        this->_remap.assign(verts.size(), ~0u);
+    }
+
+    // Optimizes the triangle ranges (all indices when there are none) and then the vertex order. The
+    // ranges must not overlap, they keep addressing the same triangles.
+    template <class VertexType>
+    MeshOptimizerStats optimize(std::vector<VertexType>& verts, std::vector<unsigned int>& indices, const std::vector<std::pair<size_t, size_t>>& ranges, unsigned int cacheSize = DefaultCacheSize)
+    {
+        MeshOptimizerStats stats;
+        analyze(indices.data(), indices.size(), verts.size(), stats.acmrBefore, stats.atvrBefore, cacheSize);
+
+        std::vector<const float*> positions;
+        if (!verts.empty() && VertexPosition<VertexType>::get(verts[0]) != nullptr)
+        {
+            positions.resize(verts.size());
+            for (size_t v = 0; v < verts.size(); v++) positions[v] = VertexPosition<VertexType>::get(verts[v]);
+        }
+
+        auto all = std::make_pair(size_t(0), indices.size());
+        for (auto& range : ranges.empty() ? std::vector<std::pair<size_t, size_t>>(1, all) : ranges)
+        {
+            this->reorderTriangles(indices.data() + range.first, range.second, verts.size(), positions.empty() ? nullptr : positions.data(), cacheSize);
+        }
+        this->reorderVertices(verts, indices.data(), indices.size());
+
+        analyze(indices.data(), indices.size(), verts.size(), stats.acmrAfter, stats.atvrAfter, cacheSize);
+        return stats;
+    }
+};
+
+#endif // GL_UTILITIES_MESHOPTIMIZER_H
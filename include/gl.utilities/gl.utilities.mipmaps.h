@@ -0,0 +1,289 @@
+#ifndef GL_UTILITIES_MIPMAPS_H
+#define GL_UTILITIES_MIPMAPS_H
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter
+{
+    Box,
+    Kaiser,
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// Full chain of RGBA8 levels, level 0 is the source image
+struct MipChain
+{
+    std::vector<MipLevel> levels;
+
+    size_t size() const
+    {
+        size_t result = 0;
+        for (auto& level : this->levels) result += level.pixels.size();
+        return result;
+    }
+};
+
+// Builds mip chains on the CPU, so it can run on loader threads instead of stalling the driver with
+// glGenerateMipmap. Every level is filtered from the RGBA8 pixels of the level above it a few rows at a
+// time, so the scratch memory is a handful of float rows and not a float copy of the image. The rows are
+// decoded to linear space, filtered with the four channels of a pixel in one SIMD register and encoded
+// again. With srgb the color channels go through lookup tables, alpha is always linear.
+class MipmapGenerator
+{
+    std::vector<float> _toLinear;
+    std::vector<unsigned char> _toSrgb;
+    std::vector<float> _kaiserWeights;
+
+    static const int KaiserTaps = 8;
+    static const int SrgbTableSize = 4096;
+
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Converts a row of RGBA8 pixels to linear floats, the sRGB color channels go through the table
+    void decodeRow(const unsigned char* source, int width, float* target, bool srgb) const
+    {
+        auto scale = simdSet1(1.0f / 255.0f);
+        for (size_t i = 0; i < size_t(width) * 4; i += 4)
+        {
+            simdStore(target + i, simdMul(simdLoadBytes(source + i), scale));
+            if (srgb)
+            {
+                target[i] = this->_toLinear[source[i]];
+                target[i + 1] = this->_toLinear[source[i + 1]];
+                target[i + 2] = this->_toLinear[source[i + 2]];
+            }
+        }
+    }
+
+    void encodeRow(const float* source, int width, unsigned char* target, bool srgb) const
+    {
+        const float srgbScale[] = { SrgbTableSize - 1, SrgbTableSize - 1, SrgbTableSize - 1, 255.0f };
+        auto scale = srgb ? simdLoad(srgbScale) : simdSet1(255.0f);
+        auto zero = simdSet1(0.0f), one = simdSet1(1.0f);
+
+        int32_t values[4];
+        for (size_t i = 0; i < size_t(width) * 4; i += 4)
+        {
+            simdStoreRounded(values, simdMul(simdMin(simdMax(simdLoad(source + i), zero), one), scale));
+            for (size_t c = 0; c < 4; c++)
+            {
+                target[i + c] = (srgb && c != 3) ? this->_toSrgb[size_t(values[c])] : static_cast<unsigned char>(values[c]);
+            }
+        }
+    }
+
+    // Fills every row of target from two decoded rows of source, the vertical sum runs over the whole row
+    void boxDownsample(const MipLevel& source, MipLevel& target, bool srgb, std::vector<float>& scratch) const
+    {
+        auto rowLength = size_t(source.width) * 4;
+        scratch.resize(rowLength * 2 + size_t(target.width) * 4);
+        auto row0 = scratch.data(), row1 = row0 + rowLength, result = row1 + rowLength;
+
+        auto quarter = simdSet1(0.25f);
+        for (int y = 0; y < target.height; y++)
+        {
+            auto y1 = 2 * y + 1 < source.height ? 2 * y + 1 : source.height - 1;
+            this->decodeRow(&source.pixels[size_t(2 * y) * rowLength], source.width, row0, srgb);
+            this->decodeRow(&source.pixels[size_t(y1) * rowLength], source.width, row1, srgb);
+            for (size_t i = 0; i < rowLength; i += 4) simdStore(row0 + i, simdAdd(simdLoad(row0 + i), simdLoad(row1 + i)));
+
+            for (int x = 0; x < target.width; x++)
+            {
+                auto x0 = size_t(2 * x) * 4;
+                auto x1 = size_t(2 * x + 1 < source.width ? 2 * x + 1 : source.width - 1) * 4;
+                simdStore(result + size_t(x) * 4, simdMul(simdAdd(simdLoad(row0 + x0), simdLoad(row0 + x1)), quarter));
+            }
+            this->encodeRow(result, target.width, &target.pixels[size_t(y) * size_t(target.width) * 4], srgb);
+        }
+    }
+
+    // Halves a decoded row with the windowed sinc
+    void kaiserRow(const float* source, int width, float* target, int targetWidth) const
+    {
+        if (targetWidth == width)
+        {
+            std::copy(source, source + size_t(width) * 4, target);
+            return;
+        }
+
+        for (int x = 0; x < targetWidth; x++)
+        {
+            auto sum = simdSet1(0.0f);
+            for (int tap = 0; tap < KaiserTaps; tap++)
+            {
+                auto index = 2 * x - KaiserTaps / 2 + 1 + tap;
+                index = index < 0 ? 0 : (index >= width ? width - 1 : index);
+                sum = simdMulAdd(simdLoad(source + size_t(index) * 4), simdSet1(this->_kaiserWeights[size_t(tap)]), sum);
+            }
+            simdStore(target + size_t(x) * 4, sum);
+        }
+    }
+
+    // Keeps the last KaiserTaps horizontally filtered rows, consecutive target rows share six of them
+    void kaiserDownsample(const MipLevel& source, MipLevel& target, bool srgb, std::vector<float>& scratch) const
+    {
+        auto rowLength = size_t(source.width) * 4, targetLength = size_t(target.width) * 4;
+        scratch.resize(rowLength + targetLength * (KaiserTaps + 1));
+        auto decoded = scratch.data(), result = decoded + rowLength, filtered = result + targetLength;
+
+        int cached[KaiserTaps];
+        Float4 weights[KaiserTaps];
+        for (int tap = 0; tap < KaiserTaps; tap++)
+        {
+            cached[tap] = -1;
+            weights[tap] = simdSet1(this->_kaiserWeights[size_t(tap)]);
+        }
+
+        for (int y = 0; y < target.height; y++)
+        {
+            const float* rows[KaiserTaps];
+            for (int tap = 0; tap < KaiserTaps; tap++)
+            {
+                auto index = target.height == source.height ? y : 2 * y - KaiserTaps / 2 + 1 + tap;
+                index = index < 0 ? 0 : (index >= source.height ? source.height - 1 : index);
+
+                auto slot = size_t(index % KaiserTaps);
+                if (cached[slot] != index)
+                {
+                    this->decodeRow(&source.pixels[size_t(index) * rowLength], source.width, decoded, srgb);
+                    this->kaiserRow(decoded, source.width, filtered + slot * targetLength, target.width);
+                    cached[slot] = index;
+                }
+                rows[tap] = filtered + slot * targetLength;
+            }
+
+            if (target.height == source.height)
+            {
+                std::copy(rows[0], rows[0] + targetLength, result);
+            }
+            else
+            {
+                for (size_t i = 0; i < targetLength; i += 4)
+                {
+                    auto sum = simdSet1(0.0f);
+                    for (int tap = 0; tap < KaiserTaps; tap++) sum = simdMulAdd(simdLoad(rows[tap] + i), weights[tap], sum);
+                    simdStore(result + i, sum);
+                }
+            }
+            this->encodeRow(result, target.width, &target.pixels[size_t(y) * targetLength], srgb);
+        }
+    }
+
+public:
+    MipmapGenerator() : _toLinear(256), _toSrgb(SrgbTableSize), _kaiserWeights(KaiserTaps)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            auto value = i / 255.0;
+            this->_toLinear[size_t(i)] = float(value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+        }
+        for (int i = 0; i < SrgbTableSize; i++)
+        {
+            auto value = double(i) / (SrgbTableSize - 1);
+            auto encoded = value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+            this->_toSrgb[size_t(i)] = static_cast<unsigned char>(encoded * 255.0 + 0.5);
+        }
+
+        // Lanczos like support of 4 source texels on each side of the target texel, alpha 4
+        const double pi = 3.14159265358979323846, alpha = 4.0;
+        double total = 0.0;
+        for (int tap = 0; tap < KaiserTaps; tap++)
+        {
+            auto distance = (tap - KaiserTaps / 2 + 0.5) / 2.0;
+            auto sinc = std::sin(pi * distance) / (pi * distance);
+            auto ratio = distance / (KaiserTaps / 4.0);
+            auto window = besselI0(alpha * std::sqrt(1.0 - ratio * ratio)) / besselI0(alpha);
+            this->_kaiserWeights[size_t(tap)] = float(sinc * window);
+            total += sinc * window;
+        }
+        for (auto& weight : this->_kaiserWeights) weight = float(weight / total);
+    }
+
+    static int levelCount(int width, int height)
+    {
+        int count = 1;
+        while (width > 1 || height > 1)
+        {
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+            count++;
+        }
+        return count;
+    }
+
+    void generate(const unsigned char* rgba, int width, int height, MipChain& chain, MipFilter filter = MipFilter::Box, bool srgb = true) const
+    {
+        chain.levels.resize(size_t(levelCount(width, height)));
+        chain.levels[0].width = width;
+        chain.levels[0].height = height;
+        chain.levels[0].pixels.assign(rgba, rgba + size_t(width) * size_t(height) * 4);
+
+        std::vector<float> scratch;
+        for (size_t level = 1; level < chain.levels.size(); level++)
+        {
+            auto& source = chain.levels[level - 1];
+            auto& target = chain.levels[level];
+            target.width = source.width > 1 ? source.width / 2 : 1;
+            target.height = source.height > 1 ? source.height / 2 : 1;
+            target.pixels.resize(size_t(target.width) * size_t(target.height) * 4);
+
+            if (filter == MipFilter::Kaiser) this->kaiserDownsample(source, target, srgb, scratch);
+            else this->boxDownsample(source, target, srgb, scratch);
+        }
+    }
+
+    // Allocates immutable storage for the whole chain on the bound GL_TEXTURE_2D and uploads it. With a
+    // bound GL_PIXEL_UNPACK_BUFFER holding the levels back to back, pass nullptr for pixels.
+    static void upload(const MipChain& chain, bool fromPixelBuffer = false)
+    {
+        auto levels = GLsizei(chain.levels.size());
+        auto& base = chain.levels[0];
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        auto immutable = Extensions::hasTextureStorage();
+        if (immutable) glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, base.width, base.height);
+        else glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        // The levels are tightly packed, the alignment of the caller is restored afterwards
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        size_t offset = 0;
+        for (GLint level = 0; level < levels; level++)
+        {
+            auto& mip = chain.levels[size_t(level)];
+            auto pixels = fromPixelBuffer ? reinterpret_cast<const GLvoid*>(offset) : reinterpret_cast<const GLvoid*>(mip.pixels.data());
+            if (immutable) glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, mip.width, mip.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            else glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            offset += mip.pixels.size();
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+};
+
+#endif // GL_UTILITIES_MIPMAPS_H
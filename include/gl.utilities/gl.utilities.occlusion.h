@@ -0,0 +1,383 @@
+#ifndef GL_UTILITIES_OCCLUSION_H
+#define GL_UTILITIES_OCCLUSION_H
+
+#include "gl.utilities.culling.h"
+#include "gl.utilities.meshoptimizer.h"
+#include "gl.utilities.simd.h"
+#include "gl.utilities.threadpool.h"
+#include "gl.utilities.vertexbuffers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Occlusion culling on the CPU without reading anything back from the GPU. Occluder triangles are
+// rasterized into a small depth buffer that is split in tiles: the triangles are set up in parallel,
+// binned to the tiles they overlap and every tile is rasterized by one thread, four pixels at a time.
+// A Hi-Z pyramid keeps the farthest depth of every 2x2 block of the level below, so a box is tested
+// by reading at most four texels of the level where its screen rectangle is about two texels wide.
+// Triangles with a corner behind the near plane are left out (not clipped), so an occluder that crosses
+// it only makes the culling less aggressive and never hides anything in front of it.
+class OcclusionCuller
+{
+    static const int TileWidth = 32;
+    static const int TileHeight = 16;
+    static const size_t TriangleGrain = 256;
+    static const size_t TestGrain = 256;
+
+    struct Triangle
+    {
+        float edges[3][3];
+        float depth[3];
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+        bool valid;
+    };
+
+    int _tilesX;
+    int _tilesY;
+    float _viewProjection[16];
+    std::vector<float> _occluders;
+    std::vector<Triangle> _triangles;
+    std::vector<std::vector<uint32_t>> _bins;
+    std::vector<std::vector<float>> _levels;
+    std::vector<int> _widths;
+    std::vector<int> _heights;
+    std::vector<uint8_t> _visibility;
+
+    static void transform(const float matrix[], const float p[], float clip[])
+    {
+        auto result = simdMulAdd(simdLoad(&matrix[0]), simdSet1(p[0]), simdMulAdd(simdLoad(&matrix[4]), simdSet1(p[1]), simdMulAdd(simdLoad(&matrix[8]), simdSet1(p[2]), simdLoad(&matrix[12]))));
+        simdStore(clip, result);
+    }
+
+    void setupTriangle(size_t index)
+    {
+        auto& triangle = this->_triangles[index];
+        triangle.valid = false;
+
+        float screen[3][3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            float clip[4];
+            transform(this->_viewProjection, &this->_occluders[(index * 3 + size_t(corner)) * 3], clip);
+            // Closer than the near plane the depth drops below zero and would occlude everything
+            if (clip[3] < 1e-5f || clip[2] < -clip[3]) return;
+
+            screen[corner][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * float(this->_widths[0]);
+            screen[corner][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * float(this->_heights[0]);
+            screen[corner][2] = clip[2] / clip[3] * 0.5f + 0.5f;
+        }
+
+        // Occluders may be drawn from both sides, so clockwise triangles are turned around
+        auto area = (screen[1][0] - screen[0][0]) * (screen[2][1] - screen[0][1]) - (screen[1][1] - screen[0][1]) * (screen[2][0] - screen[0][0]);
+        if (area < 0.0f)
+        {
+            std::swap(screen[1], screen[2]);
+            area = -area;
+        }
+        if (area < 1e-6f) return;
+
+        triangle.minX = std::max(0, int(std::floor(std::min({ screen[0][0], screen[1][0], screen[2][0] }))));
+        triangle.minY = std::max(0, int(std::floor(std::min({ screen[0][1], screen[1][1], screen[2][1] }))));
+        triangle.maxX = std::min(this->_widths[0], int(std::ceil(std::max({ screen[0][0], screen[1][0], screen[2][0] }))));
+        triangle.maxY = std::min(this->_heights[0], int(std::ceil(std::max({ screen[0][1], screen[1][1], screen[2][1] }))));
+        if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY) return;
+
+        // Edge i is opposite of corner i and is positive inside, normalized it gives the barycentric
+        // weight of that corner which interpolates the depth
+        for (int edge = 0; edge < 3; edge++)
+        {
+            auto& a = screen[(edge + 1) % 3];
+            auto& b = screen[(edge + 2) % 3];
+            triangle.edges[edge][0] = a[1] - b[1];
+            triangle.edges[edge][1] = b[0] - a[0];
+            triangle.edges[edge][2] = a[0] * b[1] - a[1] * b[0];
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            triangle.depth[c] = (triangle.edges[0][c] * screen[0][2] + triangle.edges[1][c] * screen[1][2] + triangle.edges[2][c] * screen[2][2]) / area;
+        }
+        triangle.valid = true;
+    }
+
+    void rasterizeTile(size_t tile)
+    {
+        auto tileX = int(tile % size_t(this->_tilesX)) * TileWidth;
+        auto tileY = int(tile / size_t(this->_tilesX)) * TileHeight;
+        auto width = this->_widths[0];
+        auto depth = this->_levels[0].data();
+
+        for (int y = tileY; y < tileY + TileHeight; y++)
+        {
+            std::fill(depth + y * width + tileX, depth + y * width + tileX + TileWidth, 1.0f);
+        }
+
+        const auto cleared = simdSet1(1.0f), zero = simdSet1(0.0f);
+        const float offsets[] = { 0.5f, 1.5f, 2.5f, 3.5f };
+        for (auto index : this->_bins[tile])
+        {
+            auto& triangle = this->_triangles[index];
+            auto x0 = tileX + ((std::max(triangle.minX, tileX) - tileX) & ~3);
+            auto x1 = std::min(triangle.maxX, tileX + TileWidth);
+            auto y0 = std::max(triangle.minY, tileY);
+            auto y1 = std::min(triangle.maxY, tileY + TileHeight);
+
+            Float4 a[3];
+            for (int edge = 0; edge < 3; edge++) a[edge] = simdSet1(triangle.edges[edge][0]);
+            auto depthX = simdSet1(triangle.depth[0]);
+
+            for (int y = y0; y < y1; y++)
+            {
+                auto py = float(y) + 0.5f;
+                Float4 rows[3];
+                for (int edge = 0; edge < 3; edge++) rows[edge] = simdSet1(triangle.edges[edge][1] * py + triangle.edges[edge][2]);
+                auto depthRow = simdSet1(triangle.depth[1] * py + triangle.depth[2]);
+
+                auto row = depth + y * width;
+                for (int x = x0; x < x1; x += 4)
+                {
+                    auto px = simdAdd(simdSet1(float(x)), simdLoad(offsets));
+                    auto inside = simdMin(simdMulAdd(a[0], px, rows[0]), simdMin(simdMulAdd(a[1], px, rows[1]), simdMulAdd(a[2], px, rows[2])));
+                    auto z = simdSelectLessThan(inside, zero, cleared, simdMulAdd(depthX, px, depthRow));
+                    simdStore(row + x, simdMin(simdLoad(row + x), z));
+                }
+            }
+        }
+    }
+
+    void buildLevelRows(size_t level, size_t begin, size_t end)
+    {
+        auto& source = this->_levels[level - 1];
+        auto& target = this->_levels[level];
+        auto sourceWidth = this->_widths[level - 1], sourceHeight = this->_heights[level - 1];
+        for (auto y = int(begin); y < int(end); y++)
+        {
+            auto y0 = std::min(y * 2, sourceHeight - 1), y1 = std::min(y * 2 + 1, sourceHeight - 1);
+            for (int x = 0; x < this->_widths[level]; x++)
+            {
+                auto x0 = std::min(x * 2, sourceWidth - 1), x1 = std::min(x * 2 + 1, sourceWidth - 1);
+                target[size_t(y * this->_widths[level] + x)] = std::max(
+                    std::max(source[size_t(y0 * sourceWidth + x0)], source[size_t(y0 * sourceWidth + x1)]),
+                    std::max(source[size_t(y1 * sourceWidth + x0)], source[size_t(y1 * sourceWidth + x1)]));
+            }
+        }
+    }
+
+    // Tests the box against the pyramid with the matrix from its space to clip space. Boxes that
+    // reach behind the near plane or are not finite are always visible.
+    bool testBox(const float matrix[], const float boundsMin[], const float boundsMax[]) const
+    {
+        if (this->_levels.empty()) return true;
+
+        float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f, minZ = 1.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const float p[] = { corner & 1 ? boundsMax[0] : boundsMin[0], corner & 2 ? boundsMax[1] : boundsMin[1], corner & 4 ? boundsMax[2] : boundsMin[2] };
+            float clip[4];
+            transform(matrix, p, clip);
+            if (!(clip[3] >= 1e-5f) || !std::isfinite(clip[0] + clip[1] + clip[2] + clip[3])) return true;
+
+            auto x = clip[0] / clip[3], y = clip[1] / clip[3], z = clip[2] / clip[3] * 0.5f + 0.5f;
+            minX = std::min(minX, x);
+            minY = std::min(minY, y);
+            maxX = std::max(maxX, x);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, z);
+        }
+        if (minZ < 0.0f) return true;
+
+        auto width = this->_widths[0], height = this->_heights[0];
+        auto x0 = std::max(0, int(std::floor((minX * 0.5f + 0.5f) * float(width))));
+        auto y0 = std::max(0, int(std::floor((minY * 0.5f + 0.5f) * float(height))));
+        auto x1 = std::min(width - 1, int(std::floor((maxX * 0.5f + 0.5f) * float(width))));
+        auto y1 = std::min(height - 1, int(std::floor((maxY * 0.5f + 0.5f) * float(height))));
+        if (x0 > x1 || y0 > y1) return true;
+
+        size_t level = 0;
+        while (level + 1 < this->_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) level++;
+
+        float farthest = 0.0f;
+        for (auto y = y0 >> level; y <= y1 >> level; y++)
+        {
+            for (auto x = x0 >> level; x <= x1 >> level; x++)
+            {
+                farthest = std::max(farthest, this->_levels[level][size_t(y * this->_widths[level] + x)]);
+            }
+        }
+
+        return minZ <= farthest;
+    }
+
+public:
+    OcclusionCuller() : _tilesX(0), _tilesY(0), _viewProjection() { }
+    virtual ~OcclusionCuller() { }
+
+    // The depth buffer size is rounded up to whole tiles, a few hundred pixels wide is plenty
+    void setup(int width = 256, int height = 128)
+    {
+        this->_tilesX = std::max(1, (width + TileWidth - 1) / TileWidth);
+        this->_tilesY = std::max(1, (height + TileHeight - 1) / TileHeight);
+        this->_bins.resize(size_t(this->_tilesX * this->_tilesY));
+
+        this->_widths.assign(1, this->_tilesX * TileWidth);
+        this->_heights.assign(1, this->_tilesY * TileHeight);
+        while (this->_widths.back() > 1 || this->_heights.back() > 1)
+        {
+            this->_widths.push_back(std::max(1, (this->_widths.back() + 1) / 2));
+            this->_heights.push_back(std::max(1, (this->_heights.back() + 1) / 2));
+        }
+
+        this->_levels.resize(this->_widths.size());
+        for (size_t level = 0; level < this->_levels.size(); level++)
+        {
+            this->_levels[level].assign(size_t(this->_widths[level] * this->_heights[level]), 1.0f);
+        }
+    }
+
+    // Adds the triangles of a triangle list, transformed with the column major model matrix. Only
+    // vertex types with float positions can be occluders.
+    template <class VertexType>
+    bool addOccluder(const VertexType* verts, size_t count, const float model[])
+    {
+        if (count > 0 && VertexPosition<VertexType>::get(verts[0]) == nullptr)
+        {
+            std::cout << "Occluders need float positions" << std::endl;
+            return false;
+        }
+
+        auto first = this->_occluders.size();
+        this->_occluders.resize(first + count / 3 * 9);
+        for (size_t i = 0; i < count / 3 * 3; i++)
+        {
+            auto p = VertexPosition<VertexType>::get(verts[i]);
+            auto world = &this->_occluders[first + i * 3];
+            for (int r = 0; r < 3; r++) world[r] = model[r] * p[0] + model[4 + r] * p[1] + model[8 + r] * p[2] + model[12 + r];
+        }
+
+        return true;
+    }
+
+    template <class VertexType>
+    bool addOccluder(const std::vector<VertexType>& verts, const float model[])
+    {
+        return this->addOccluder(verts.data(), verts.size(), model);
+    }
+
+    // Adds the vertices of a builder drawn as triangles, set it up with VertexRelease::Keep so they
+    // are still there
+    template <class VertexType, class ShaderType>
+    bool addOccluder(const VertexBuilder<VertexType, ShaderType>& buffer, const float model[])
+    {
+        if (buffer._drawMode != GL_TRIANGLES)
+        {
+            std::cout << "Occluders must be drawn as triangles" << std::endl;
+            return false;
+        }
+        if (buffer.verts().empty() && buffer.vertexCount() > 0)
+        {
+            std::cout << "The vertices of the occluder were released, use VertexRelease::Keep" << std::endl;
+            return false;
+        }
+
+        return this->addOccluder(buffer.verts(), model);
+    }
+
+    void clearOccluders() { this->_occluders.clear(); }
+
+    // Rasterizes the occluders as seen through the column major view projection matrix and builds the
+    // pyramid, call this once per frame before testing
+    void render(const float viewProjection[], ThreadPool* pool = nullptr)
+    {
+        if (this->_levels.empty()) this->setup();
+        std::copy(viewProjection, viewProjection + 16, this->_viewProjection);
+
+        auto triangleCount = this->_occluders.size() / 9;
+        this->_triangles.resize(triangleCount);
+        auto setupRange = [this] (size_t begin, size_t end) { for (auto i = begin; i < end; i++) this->setupTriangle(i); };
+        if (pool != nullptr) pool->parallelFor(triangleCount, TriangleGrain, setupRange);
+        else setupRange(0, triangleCount);
+
+        for (auto& bin : this->_bins) bin.clear();
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            auto& triangle = this->_triangles[i];
+            if (!triangle.valid) continue;
+
+            for (auto tileY = triangle.minY / TileHeight; tileY <= (triangle.maxY - 1) / TileHeight; tileY++)
+            {
+                for (auto tileX = triangle.minX / TileWidth; tileX <= (triangle.maxX - 1) / TileWidth; tileX++)
+                {
+                    this->_bins[size_t(tileY * this->_tilesX + tileX)].push_back(uint32_t(i));
+                }
+            }
+        }
+
+        auto tileCount = this->_bins.size();
+        auto rasterizeRange = [this] (size_t begin, size_t end) { for (auto i = begin; i < end; i++) this->rasterizeTile(i); };
+        if (pool != nullptr) pool->parallelFor(tileCount, 1, rasterizeRange);
+        else rasterizeRange(0, tileCount);
+
+        for (size_t level = 1; level < this->_levels.size(); level++)
+        {
+            auto rows = size_t(this->_heights[level]);
+            auto buildRange = [this, level] (size_t begin, size_t end) { this->buildLevelRows(level, begin, end); };
+            if (pool != nullptr && rows >= 16) pool->parallelFor(rows, 8, buildRange);
+            else buildRange(0, rows);
+        }
+    }
+
+    // True when the world space box may be visible
+    bool test(const float boundsMin[], const float boundsMax[]) const
+    {
+        return this->testBox(this->_viewProjection, boundsMin, boundsMax);
+    }
+
+    // True when the buffer drawn with the model matrix may be visible, always for buffers
+    // without bounds
+    bool test(const RenderableBuffer& buffer, const float model[]) const
+    {
+        if (!buffer.hasBounds()) return true;
+
+        float matrix[16];
+        simdMultiplyMatrices(this->_viewProjection, model, matrix);
+        return this->testBox(matrix, buffer.boundsMin(), buffer.boundsMax());
+    }
+
+    // Removes the occluded objects from the list the frustum culler returned
+    void cull(const FrustumCuller& frustum, std::vector<FrustumCuller::Handle>& visible, ThreadPool* pool = nullptr)
+    {
+        this->_visibility.resize(visible.size());
+        auto testRange = [this, &frustum, &visible] (size_t begin, size_t end)
+        {
+            for (auto i = begin; i < end; i++)
+            {
+                float boundsMin[3], boundsMax[3];
+                frustum.bounds(visible[i], boundsMin, boundsMax);
+                this->_visibility[i] = this->test(boundsMin, boundsMax) ? 1 : 0;
+            }
+        };
+        if (pool != nullptr) pool->parallelFor(visible.size(), TestGrain, testRange);
+        else testRange(0, visible.size());
+
+        size_t count = 0;
+        for (size_t i = 0; i < visible.size(); i++)
+        {
+            if (this->_visibility[i] != 0) visible[count++] = visible[i];
+        }
+        visible.resize(count);
+    }
+
+    int width() const { return this->_widths.empty() ? 0 : this->_widths[0]; }
+    int height() const { return this->_heights.empty() ? 0 : this->_heights[0]; }
+    int levelCount() const { return int(this->_levels.size()); }
+
+    // The depth of a pyramid level in [0, 1], level 0 is the rasterized depth buffer
+    const float* depth(int level = 0) const { return this->_levels[size_t(level)].data(); }
+};
+
+#endif // GL_UTILITIES_OCCLUSION_H
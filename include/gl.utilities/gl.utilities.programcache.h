@@ -0,0 +1,189 @@
+#ifndef GL_UTILITIES_PROGRAMCACHE_H
+#define GL_UTILITIES_PROGRAMCACHE_H
+
+#ifdef _WIN32
+#include <glad/glad.h>
+#endif // _WIN32
+
+#ifdef __ANDROID__
+#include <GLES/gl.h>
+#include <GLES3/gl3.h>
+#endif // __ANDROID__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif // _WIN32
+
+// Stores linked program binaries on disk so later runs can skip the driver compiler. Entries are keyed
+// on both sources, the attribute locations bound before linking and the renderer and version strings,
+// a driver update gives new keys. Every file repeats the full key and driver string, which are compared
+// before the binary is handed to the driver. When the driver rejects a stored binary the caller falls
+// back to compiling from source.
+class ProgramBinaryCache
+{
+    static const uint32_t Magic = 0x42504C47; // "GLPB"
+    static const uint32_t Version = 3;
+    static const size_t KeyLength = 32;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t driverLength;
+        char key[KeyLength];
+    };
+
+    std::string _directory;
+    std::string _driver;
+    bool _created;
+
+    static uint64_t hash(uint64_t hash, const std::string& str)
+    {
+        for (auto c : str) hash = (hash ^ uint64_t(static_cast<unsigned char>(c))) * 1099511628211ull;
+        return (hash ^ 0xFF) * 1099511628211ull;
+    }
+
+    static void appendHex(std::string& result, uint64_t value)
+    {
+        const char digits[] = "0123456789abcdef";
+        for (int shift = 60; shift >= 0; shift -= 4) result += digits[(value >> shift) & 0xF];
+    }
+
+    // Creates the directory and its parents when they do not exist yet
+    static bool createDirectories(const std::string& path)
+    {
+        for (size_t i = 1; i <= path.size(); i++)
+        {
+            if (i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+            if (path[i - 1] == ':' || path[i - 1] == '/' || path[i - 1] == '\\') continue;
+
+            auto part = path.substr(0, i);
+#ifdef _WIN32
+            auto result = _mkdir(part.c_str());
+#else
+            auto result = mkdir(part.c_str(), 0755);
+#endif // _WIN32
+            if (result != 0 && errno != EEXIST) return false;
+        }
+
+        return true;
+    }
+
+    const std::string& driver()
+    {
+        if (this->_driver.empty())
+        {
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            auto version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+            this->_driver = std::string(renderer != nullptr ? renderer : "") + "|" + (version != nullptr ? version : "");
+        }
+
+        return this->_driver;
+    }
+
+public:
+    ProgramBinaryCache(const std::string& directory) : _directory(directory), _created(false) { }
+    virtual ~ProgramBinaryCache() { }
+
+    bool supported() const
+    {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    // Two independent 64 bit hashes of the sources, the attribute bindings and the driver
+    std::string key(const std::string& vertShaderStr, const std::string& fragShaderStr, const std::vector<std::pair<std::string, GLuint>>& attributeBindings = std::vector<std::pair<std::string, GLuint>>())
+    {
+        auto& driver = this->driver();
+
+        std::string attributes;
+        for (auto& binding : attributeBindings) attributes += binding.first + "=" + std::to_string(binding.second) + ";";
+
+        std::string name;
+        appendHex(name, hash(hash(hash(hash(14695981039346656037ull, vertShaderStr), fragShaderStr), attributes), driver));
+        appendHex(name, hash(hash(hash(hash(0x84222325CBF29CE4ull, driver), attributes), fragShaderStr), vertShaderStr));
+
+        return name;
+    }
+
+    std::string filename(const std::string& key) const { return this->_directory + "/" + key + ".bin"; }
+
+    // Loads the binary into program, returns false when there is none, when it was stored for other
+    // sources or another driver, or when the driver rejects it
+    bool load(GLuint program, const std::string& key)
+    {
+        std::ifstream file(this->filename(key).c_str(), std::ios::binary);
+        if (!file) return false;
+
+        Header header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        if (header.magic != Magic || header.version != Version) return false;
+        if (key.size() != KeyLength || std::memcmp(header.key, key.data(), KeyLength) != 0) return false;
+
+        auto& driver = this->driver();
+        std::string storedDriver(header.driverLength, '\0');
+        if (header.driverLength != driver.size() || !file.read(&storedDriver[0], std::streamsize(storedDriver.size())) || storedDriver != driver) return false;
+
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty()) return false;
+
+        glProgramBinary(program, GLenum(header.format), binary.data(), GLsizei(binary.size()));
+
+        GLint result = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+
+        return result == GL_TRUE;
+    }
+
+    bool store(GLuint program, const std::string& key)
+    {
+        if (key.size() != KeyLength) return false;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+
+        std::vector<char> binary(static_cast<size_t>(length));
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        if (length <= 0) return false;
+
+        if (!this->_created && !createDirectories(this->_directory))
+        {
+            std::cout << "Unable to create the program cache directory " << this->_directory << std::endl;
+            return false;
+        }
+        this->_created = true;
+
+        auto& driver = this->driver();
+        Header header = { Magic, Version, uint32_t(format), uint32_t(driver.size()), { } };
+        std::memcpy(header.key, key.data(), KeyLength);
+
+        std::ofstream file(this->filename(key).c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(driver.data(), std::streamsize(driver.size()));
+        file.write(binary.data(), length);
+        if (!file)
+        {
+            std::cout << "Unable to write " << this->filename(key) << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+};
+
+#endif // GL_UTILITIES_PROGRAMCACHE_H
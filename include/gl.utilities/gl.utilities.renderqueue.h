@@ -0,0 +1,191 @@
+#ifndef GL_UTILITIES_RENDERQUEUE_H
+#define GL_UTILITIES_RENDERQUEUE_H
+
+#include "gl.utilities.shaders.h"
+#include "gl.utilities.textures.h"
+#include "gl.utilities.vertexbuffers.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+// Sorts 64 bit keys with a stable LSD radix sort, 8 bits per pass. Passes where every key has the same
+// byte are skipped. The values are sorted along with the keys.
+inline void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values)
+{
+    std::vector<uint64_t> keysTemp(keys.size());
+    std::vector<uint32_t> valuesTemp(values.size());
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = { 0 };
+        for (auto key : keys) counts[(key >> shift) & 0xFF]++;
+        if (keys.empty() || counts[(keys[0] >> shift) & 0xFF] == keys.size()) continue;
+
+        size_t offset = 0;
+        for (auto& count : counts)
+        {
+            auto current = count;
+            count = offset;
+            offset += current;
+        }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            auto target = counts[(keys[i] >> shift) & 0xFF]++;
+            keysTemp[target] = keys[i];
+            valuesTemp[target] = values[i];
+        }
+        keys.swap(keysTemp);
+        values.swap(valuesTemp);
+    }
+}
+
+// Collects draws for a frame and submits them sorted on program, texture, vertex array and depth, so
+// state only changes when it has to. The key is 14 bits program, 16 bits texture, 14 bits vertex array
+// and 20 bits depth, larger GL names are folded which only costs sorting quality.
+class RenderQueue
+{
+    struct DrawUniform
+    {
+        GLint location;
+        GLenum type;
+        uint32_t offset;
+    };
+
+    struct DrawItem
+    {
+        PVMShader* shader;
+        const Texture* texture;
+        RenderableBuffer* buffer;
+        uint32_t modelOffset;
+        uint32_t firstUniform;
+        uint32_t uniformCount;
+    };
+
+    std::vector<DrawItem> _items;
+    std::vector<DrawUniform> _uniforms;
+    std::vector<float> _data;
+    std::vector<uint64_t> _keys;
+    std::vector<uint32_t> _order;
+    float _projection[16];
+    float _view[16];
+    float _viewportHeight;
+
+    static uint64_t depthBits(float depth)
+    {
+        if (!(depth > 0.0f)) return 0;
+
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+
+        return bits >> 11;
+    }
+
+    void addUniform(GLint location, GLenum type, const float* values, size_t count)
+    {
+        if (this->_items.empty()) return;
+
+        DrawUniform uniform = { location, type, uint32_t(this->_data.size()) };
+        this->_data.insert(this->_data.end(), values, values + count);
+        this->_uniforms.push_back(uniform);
+        this->_items.back().uniformCount++;
+    }
+
+public:
+    RenderQueue() : _viewportHeight(0.0f)
+    {
+        for (int i = 0; i < 16; i++) this->_projection[i] = this->_view[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+    virtual ~RenderQueue() { }
+
+    size_t size() const { return this->_items.size(); }
+
+    // With the viewport height in pixels the buffers pick their level of detail from it
+    void setCamera(const float projection[], const float view[], float viewportHeight = 0.0f)
+    {
+        std::memcpy(this->_projection, projection, sizeof(this->_projection));
+        std::memcpy(this->_view, view, sizeof(this->_view));
+        this->_viewportHeight = viewportHeight;
+    }
+
+    // Depth is the view distance, smaller values are drawn first. The texture may be null.
+    void add(PVMShader& shader, const Texture* texture, RenderableBuffer& buffer, const float model[], float depth)
+    {
+        DrawItem item = { &shader, texture, &buffer, uint32_t(this->_data.size()), uint32_t(this->_uniforms.size()), 0 };
+        this->_data.insert(this->_data.end(), model, model + 16);
+        this->_items.push_back(item);
+
+        uint64_t key = (uint64_t(shader.id() & 0x3FFF) << 50)
+                | (uint64_t((texture != nullptr ? texture->id() : 0) & 0xFFFF) << 34)
+                | (uint64_t(buffer._vertexArrayId & 0x3FFF) << 20)
+                | depthBits(depth);
+        this->_keys.push_back(key);
+    }
+
+    // Extra uniforms for the last added draw
+    void uniform1f(GLint location, float value) { this->addUniform(location, GL_FLOAT, &value, 1); }
+    void uniform4fv(GLint location, const float values[]) { this->addUniform(location, GL_FLOAT_VEC4, values, 4); }
+    void uniformMatrix4fv(GLint location, const float values[]) { this->addUniform(location, GL_FLOAT_MAT4, values, 16); }
+
+    // Sorts and submits all draws and empties the queue
+    void flush()
+    {
+        this->_order.resize(this->_items.size());
+        for (size_t i = 0; i < this->_order.size(); i++) this->_order[i] = uint32_t(i);
+
+        radixSort(this->_keys, this->_order);
+
+        PVMShader* currentShader = nullptr;
+        const Texture* currentTexture = nullptr;
+        for (auto index : this->_order)
+        {
+            auto& item = this->_items[index];
+
+            if (item.shader != currentShader)
+            {
+                currentShader = item.shader;
+                currentShader->use();
+                currentShader->setUniformMatrix4fv(GLint(currentShader->_projectionUniformId), this->_projection);
+                currentShader->setUniformMatrix4fv(GLint(currentShader->_viewUniformId), this->_view);
+            }
+            if (item.texture != nullptr && item.texture != currentTexture)
+            {
+                currentTexture = item.texture;
+                currentTexture->use(0);
+            }
+
+            currentShader->setUniformMatrix4fv(GLint(currentShader->_modelUniformId), &this->_data[item.modelOffset]);
+            for (uint32_t i = 0; i < item.uniformCount; i++)
+            {
+                auto& uniform = this->_uniforms[item.firstUniform + i];
+                auto values = &this->_data[uniform.offset];
+                switch (uniform.type)
+                {
+                    case GL_FLOAT: currentShader->setUniform1f(uniform.location, values[0]); break;
+                    case GL_FLOAT_VEC4: currentShader->setUniform4fv(uniform.location, values); break;
+                    case GL_FLOAT_MAT4: currentShader->setUniformMatrix4fv(uniform.location, values); break;
+                }
+            }
+
+            if (this->_viewportHeight > 0.0f && item.buffer->lodCount() > 1)
+            {
+                item.buffer->setProjectedSize(item.buffer->projectedRadius(this->_projection, this->_view, &this->_data[item.modelOffset], this->_viewportHeight));
+            }
+            item.buffer->render();
+        }
+
+        this->clear();
+    }
+
+    void clear()
+    {
+        this->_items.clear();
+        this->_uniforms.clear();
+        this->_data.clear();
+        this->_keys.clear();
+        this->_order.clear();
+    }
+};
+
+#endif // GL_UTILITIES_RENDERQUEUE_H
@@ -0,0 +1,175 @@
+#ifndef GL_UTILITIES_RESIDENCY_H
+#define GL_UTILITIES_RESIDENCY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Keeps the GPU memory of the tracked textures and buffers under a budget. Resources are marked on
+// every use, nextFrame() evicts the least recently used ones that were not used in the current frame
+// until the usage fits the budget again. An evicted resource is reloaded from its source on its next use.
+class ResidencyManager
+{
+public:
+    typedef size_t Handle;
+
+    struct Stats
+    {
+        size_t budget;
+        size_t usage;
+        size_t peak;
+        int resident;
+        int evicted;
+        unsigned int evictions;
+        unsigned int reloads;
+    };
+
+private:
+    struct Entry
+    {
+        size_t bytes;
+        unsigned int lastUse;
+        bool resident;
+        bool live;
+        std::function<bool()> reload;
+        std::function<void()> evict;
+    };
+
+    std::vector<Entry> _entries;
+    std::vector<Handle> _free;
+    std::vector<Handle> _candidates;
+    size_t _budget;
+    size_t _usage;
+    size_t _peak;
+    unsigned int _frame;
+    unsigned int _evictions;
+    unsigned int _reloads;
+
+public:
+    ResidencyManager(size_t budget) : _budget(budget), _usage(0), _peak(0), _frame(0), _evictions(0), _reloads(0) { }
+    virtual ~ResidencyManager() { }
+
+    // Bytes of a texture with the given size and format, including its mip levels
+    static size_t textureBytes(int width, int height, float bytesPerPixel = 4.0f, bool mipmapped = true)
+    {
+        auto bytes = double(width) * double(height) * double(bytesPerPixel);
+        return size_t(mipmapped ? bytes * 4.0 / 3.0 : bytes);
+    }
+
+    Handle add(size_t bytes, std::function<bool()> reload, std::function<void()> evict)
+    {
+        Handle handle;
+        if (!this->_free.empty())
+        {
+            handle = this->_free.back();
+            this->_free.pop_back();
+        }
+        else
+        {
+            handle = this->_entries.size();
+            this->_entries.push_back(Entry());
+        }
+
+        this->_entries[handle] = { bytes, this->_frame, true, true, reload, evict };
+        this->_usage += bytes;
+        this->_peak = std::max(this->_peak, this->_usage);
+
+        return handle;
+    }
+
+    void remove(Handle handle)
+    {
+        auto& entry = this->_entries[handle];
+        if (entry.resident) this->_usage -= entry.bytes;
+        entry = Entry();
+        entry.live = false;
+        this->_free.push_back(handle);
+    }
+
+    void resize(Handle handle, size_t bytes)
+    {
+        auto& entry = this->_entries[handle];
+        if (entry.resident) this->_usage = this->_usage - entry.bytes + bytes;
+        entry.bytes = bytes;
+        this->_peak = std::max(this->_peak, this->_usage);
+    }
+
+    // Marks the resource as used in this frame, an evicted resource is reloaded first
+    bool touch(Handle handle)
+    {
+        auto& entry = this->_entries[handle];
+        entry.lastUse = this->_frame;
+        if (entry.resident) return true;
+
+        // The reload may add or resize resources, so the entry is looked up again afterwards
+        auto reload = entry.reload;
+        auto result = reload && reload();
+        this->_reloads++;
+
+        auto& reloaded = this->_entries[handle];
+        reloaded.resident = result;
+        if (result) this->_usage += reloaded.bytes;
+        this->_peak = std::max(this->_peak, this->_usage);
+
+        return result;
+    }
+
+    void setBudget(size_t budget) { this->_budget = budget; }
+
+    // Evicts least recently used resources until the usage fits the budget, resources used in this
+    // frame are kept even when that is not enough
+    void trim()
+    {
+        if (this->_usage <= this->_budget) return;
+
+        this->_candidates.clear();
+        for (Handle i = 0; i < this->_entries.size(); i++)
+        {
+            auto& entry = this->_entries[i];
+            if (entry.live && entry.resident && entry.lastUse != this->_frame) this->_candidates.push_back(i);
+        }
+
+        std::sort(this->_candidates.begin(), this->_candidates.end(), [this] (Handle a, Handle b)
+        {
+            return this->_entries[a].lastUse < this->_entries[b].lastUse;
+        });
+
+        for (auto handle : this->_candidates)
+        {
+            if (this->_usage <= this->_budget) break;
+
+            auto& entry = this->_entries[handle];
+            if (entry.evict) entry.evict();
+            entry.resident = false;
+            this->_usage -= entry.bytes;
+            this->_evictions++;
+        }
+    }
+
+    // Call this once at the end of every frame
+    void nextFrame()
+    {
+        this->trim();
+        this->_frame++;
+    }
+
+    Stats stats() const
+    {
+        Stats stats = { this->_budget, this->_usage, this->_peak, 0, 0, this->_evictions, this->_reloads };
+        for (auto& entry : this->_entries)
+        {
+            if (!entry.live) continue;
+            if (entry.resident) stats.resident++;
+            else stats.evicted++;
+        }
+
+        return stats;
+    }
+
+    size_t budget() const { return this->_budget; }
+    size_t usage() const { return this->_usage; }
+    unsigned int frame() const { return this->_frame; }
+};
+
+#endif // GL_UTILITIES_RESIDENCY_H
@@ -0,0 +1,87 @@
+#ifndef GL_UTILITIES_SHADERCOMPILER_H
+#define GL_UTILITIES_SHADERCOMPILER_H
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.shaders.h"
+
+#include <string>
+#include <vector>
+
+// Batch compiler, submit all programs up front and call poll() once per frame (while rendering a
+// loading screen) until it returns true. With KHR_parallel_shader_compile only programs the driver
+// reports as completed are finished, without it one program is finished per poll.
+class ShaderCompiler
+{
+    struct Job
+    {
+        CompiledShader* shader;
+        bool done;
+        bool result;
+    };
+
+    std::vector<Job> _jobs;
+    size_t _finished;
+    size_t _failed;
+    bool _parallel;
+
+public:
+    ShaderCompiler()
+        : _finished(0), _failed(0),
+          _parallel(Extensions::hasParallelShaderCompile())
+    { }
+    virtual ~ShaderCompiler() { }
+
+    bool parallel() const { return this->_parallel; }
+    size_t count() const { return this->_jobs.size(); }
+    size_t finished() const { return this->_finished; }
+    size_t failed() const { return this->_failed; }
+
+    bool add(CompiledShader* shader, const std::string& vertShaderStr, const std::string& fragShaderStr)
+    {
+        Job job = { shader, false, false };
+        if (!shader->submit(vertShaderStr, fragShaderStr))
+        {
+            job.done = true;
+            this->_finished++;
+            this->_failed++;
+        }
+        this->_jobs.push_back(job);
+
+        return !job.done;
+    }
+
+    bool poll()
+    {
+        for (auto& job : this->_jobs)
+        {
+            if (job.done || !job.shader->isReady(this->_parallel)) continue;
+
+            job.done = true;
+            job.result = job.shader->finish();
+            this->_finished++;
+            if (!job.result) this->_failed++;
+
+            if (!this->_parallel) break;
+        }
+
+        return this->_finished == this->_jobs.size();
+    }
+
+    // Blocks until every program is finished, returns false when any of them failed
+    bool finishAll()
+    {
+        for (auto& job : this->_jobs)
+        {
+            if (job.done) continue;
+
+            job.done = true;
+            job.result = job.shader->finish();
+            this->_finished++;
+            if (!job.result) this->_failed++;
+        }
+
+        return this->_failed == 0;
+    }
+};
+
+#endif // GL_UTILITIES_SHADERCOMPILER_H
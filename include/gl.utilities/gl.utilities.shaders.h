@@ -15,18 +15,250 @@
 #include <iostream>
 #include <fstream>
 #include <streambuf>
+#include <cstring>
+#include <cstddef>
+#include <utility>
+
+#include "gl.utilities.programcache.h"
+#include "gl.utilities.state.h"
+#include "gl.utilities.uniformbuffers.h"
+#include "gl.utilities.vertexlayout.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Reflection
+struct ShaderUniform
+{
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+    size_t shadowOffset;
+    size_t shadowSize;
+    bool shadowValid;
+};
+
+struct ShaderAttribute
+{
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+struct ShaderUniformBlock
+{
+    std::string name;
+    GLuint index;
+    GLint dataSize;
+};
+
+inline size_t uniformTypeSize(GLenum type)
+{
+    switch (type)
+    {
+        case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL: return 4;
+        case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: return 8;
+        case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: return 12;
+        case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2: return 16;
+        case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2: return 24;
+        case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2: return 32;
+        case GL_FLOAT_MAT3: return 36;
+        case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3: return 48;
+        case GL_FLOAT_MAT4: return 64;
+        default: return 4; // samplers and images
+    }
+}
+
+inline size_t hashName(const char* name)
+{
+    size_t hash = 2166136261u;
+    for (; *name != '\0'; name++) hash = (hash ^ size_t(*name)) * 16777619u;
+    return hash;
+}
 
 // Shaders
 class CompiledShader
 {
 protected:
+    // Copies the value into the shadow of the uniform at location, returns false when it did not change.
+    // Locations that were not reflected are always uploaded.
+    bool updateShadow(GLint location, const void* data, size_t bytes)
+    {
+        if (location < 0 || size_t(location) >= this->_uniformByLocation.size() || this->_uniformByLocation[size_t(location)] < 0)
+            return location >= 0;
+
+        auto& uniform = this->_uniforms[size_t(this->_uniformByLocation[size_t(location)])];
+        if (bytes > uniform.shadowSize)
+        {
+            uniform.shadowValid = false;
+            return true;
+        }
+
+        auto shadow = &this->_uniformShadow[uniform.shadowOffset];
+        if (uniform.shadowValid && std::memcmp(shadow, data, bytes) == 0)
+        {
+            this->_skippedUniformUploads++;
+            return false;
+        }
+
+        std::memcpy(shadow, data, bytes);
+        uniform.shadowValid = bytes == uniform.shadowSize;
+
+        return true;
+    }
+
 public:
     GLuint _shaderId;
-    CompiledShader() : _shaderId(0) { }
+    std::vector<ShaderUniform> _uniforms;
+    std::vector<ShaderAttribute> _attributes;
+    std::vector<ShaderUniformBlock> _uniformBlocks;
+    std::vector<int> _uniformSlots;
+    std::vector<int> _uniformByLocation;
+    std::vector<unsigned char> _uniformShadow;
+    unsigned int _skippedUniformUploads;
+    ProgramBinaryCache* _binaryCache;
+    GLuint _pendingVertShader;
+    GLuint _pendingFragShader;
+    std::string _pendingCacheKey;
+    bool _pendingFromCache;
+    std::vector<std::pair<std::string, GLuint>> _attributeBindings;
+
+    CompiledShader()
+        : _shaderId(0), _skippedUniformUploads(0), _binaryCache(nullptr),
+          _pendingVertShader(0), _pendingFragShader(0), _pendingFromCache(false)
+    { }
     virtual ~CompiledShader() { }
 
     GLuint id() const { return this->_shaderId; }
 
+    // When set, compile() first tries a stored program binary and stores the binary after linking
+    void setBinaryCache(ProgramBinaryCache* cache) { this->_binaryCache = cache; }
+    unsigned int skippedUniformUploads() const { return this->_skippedUniformUploads; }
+
+    // Enumerates the active uniforms, attributes and uniform blocks of the linked program. Uniforms are
+    // kept in a flat array with an open addressing table on their name and one on their location.
+    void reflect()
+    {
+        this->_uniforms.clear();
+        this->_attributes.clear();
+        this->_uniformBlocks.clear();
+        this->_uniformShadow.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(size_t(maxLength > 0 ? maxLength : 1) + 1);
+
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_UNIFORMS, &count);
+        GLint maxLocation = -1;
+        for (GLint i = 0; i < count; i++)
+        {
+            ShaderUniform uniform;
+            GLsizei length = 0;
+            glGetActiveUniform(this->_shaderId, GLuint(i), GLsizei(name.size()), &length, &uniform.size, &uniform.type, &name[0]);
+            uniform.name.assign(&name[0], size_t(length));
+            if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+                uniform.name.resize(uniform.name.size() - 3);
+
+            // Uniforms inside blocks have no location
+            uniform.location = glGetUniformLocation(this->_shaderId, uniform.name.c_str());
+            if (uniform.location < 0) continue;
+
+            uniform.shadowOffset = this->_uniformShadow.size();
+            uniform.shadowSize = uniformTypeSize(uniform.type) * size_t(uniform.size);
+            uniform.shadowValid = false;
+            this->_uniformShadow.resize(this->_uniformShadow.size() + uniform.shadowSize);
+
+            maxLocation = uniform.location > maxLocation ? uniform.location : maxLocation;
+            this->_uniforms.push_back(uniform);
+        }
+
+        size_t slotCount = 8;
+        while (slotCount < this->_uniforms.size() * 2) slotCount <<= 1;
+        this->_uniformSlots.assign(slotCount, -1);
+        this->_uniformByLocation.assign(size_t(maxLocation + 1), -1);
+        for (size_t i = 0; i < this->_uniforms.size(); i++)
+        {
+            auto slot = hashName(this->_uniforms[i].name.c_str()) & (slotCount - 1);
+            while (this->_uniformSlots[slot] >= 0) slot = (slot + 1) & (slotCount - 1);
+            this->_uniformSlots[slot] = int(i);
+            this->_uniformByLocation[size_t(this->_uniforms[i].location)] = int(i);
+        }
+
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.resize(size_t(maxLength > 0 ? maxLength : 1) + 1);
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_ATTRIBUTES, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            ShaderAttribute attribute;
+            GLsizei length = 0;
+            glGetActiveAttrib(this->_shaderId, GLuint(i), GLsizei(name.size()), &length, &attribute.size, &attribute.type, &name[0]);
+            attribute.name.assign(&name[0], size_t(length));
+            attribute.location = glGetAttribLocation(this->_shaderId, attribute.name.c_str());
+            this->_attributes.push_back(attribute);
+        }
+
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.resize(size_t(maxLength > 0 ? maxLength : 1) + 1);
+        glGetProgramiv(this->_shaderId, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            ShaderUniformBlock block;
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(this->_shaderId, GLuint(i), GLsizei(name.size()), &length, &name[0]);
+            block.name.assign(&name[0], size_t(length));
+            block.index = GLuint(i);
+            glGetActiveUniformBlockiv(this->_shaderId, GLuint(i), GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            this->_uniformBlocks.push_back(block);
+        }
+    }
+
+    const ShaderUniform* findUniform(const std::string& name) const
+    {
+        if (this->_uniformSlots.empty()) return nullptr;
+
+        auto mask = this->_uniformSlots.size() - 1;
+        for (auto slot = hashName(name.c_str()) & mask; this->_uniformSlots[slot] >= 0; slot = (slot + 1) & mask)
+        {
+            auto& uniform = this->_uniforms[size_t(this->_uniformSlots[slot])];
+            if (uniform.name == name) return &uniform;
+        }
+
+        return nullptr;
+    }
+
+    GLint uniformLocation(const std::string& name) const
+    {
+        auto uniform = this->findUniform(name);
+        return uniform != nullptr ? uniform->location : -1;
+    }
+
+    // Connects the named uniform block to a binding point, returns false when the program has no such block
+    bool bindUniformBlock(const std::string& name, GLuint binding) const
+    {
+        for (auto& block : this->_uniformBlocks)
+        {
+            if (block.name != name) continue;
+
+            glUniformBlockBinding(this->_shaderId, block.index, binding);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Cached uniform setters, these skip the upload when the value did not change since the last
+    // call. They expect the program to be in use, like glUniform does.
+    void setUniform1i(GLint location, GLint value) { if (this->updateShadow(location, &value, sizeof(value))) glUniform1i(location, value); }
+    void setUniform1f(GLint location, GLfloat value) { if (this->updateShadow(location, &value, sizeof(value))) glUniform1f(location, value); }
+    void setUniform2fv(GLint location, const GLfloat* values, GLsizei count = 1) { if (this->updateShadow(location, values, sizeof(GLfloat) * 2 * size_t(count))) glUniform2fv(location, count, values); }
+    void setUniform3fv(GLint location, const GLfloat* values, GLsizei count = 1) { if (this->updateShadow(location, values, sizeof(GLfloat) * 3 * size_t(count))) glUniform3fv(location, count, values); }
+    void setUniform4fv(GLint location, const GLfloat* values, GLsizei count = 1) { if (this->updateShadow(location, values, sizeof(GLfloat) * 4 * size_t(count))) glUniform4fv(location, count, values); }
+    void setUniformMatrix3fv(GLint location, const GLfloat* values, GLsizei count = 1) { if (this->updateShadow(location, values, sizeof(GLfloat) * 9 * size_t(count))) glUniformMatrix3fv(location, count, GL_FALSE, values); }
+    void setUniformMatrix4fv(GLint location, const GLfloat* values, GLsizei count = 1) { if (this->updateShadow(location, values, sizeof(GLfloat) * 16 * size_t(count))) glUniformMatrix4fv(location, count, GL_FALSE, values); }
+
     virtual bool compileFromFile(const std::string& vertShaderFile, const std::string& fragShaderFile)
     {
         std::ifstream vertShaderFileStream(vertShaderFile.c_str());
@@ -40,121 +272,243 @@ public:
         return compile(vertShaderStr, fragShaderStr);
     }
 
+    // Compiles and links in one go, see submit() and finish() to spread this over several frames
     virtual bool compile(const std::string& vertShaderStr, const std::string& fragShaderStr)
     {
-        GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
-        GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
+        if (!this->submit(vertShaderStr, fragShaderStr))
+            return false;
+
+        return this->finish();
+    }
+
+    // Hands the sources to the driver without asking for any status, so the driver is free to compile
+    // and link in the background until finish() is called
+    bool submit(const std::string& vertShaderStr, const std::string& fragShaderStr)
+    {
+        this->_pendingCacheKey.clear();
+        this->_pendingFromCache = false;
+
+        // A stored binary keeps the locations it was linked with, so they are part of its key
+        this->_attributeBindings.clear();
+        this->bindAttributes();
+
+        if (this->_binaryCache != nullptr && this->_binaryCache->supported())
+        {
+            this->_pendingCacheKey = this->_binaryCache->key(vertShaderStr, fragShaderStr, this->_attributeBindings);
+
+            this->_shaderId = glCreateProgram();
+            if (this->_binaryCache->load(this->_shaderId, this->_pendingCacheKey))
+            {
+                this->_pendingFromCache = true;
+                return true;
+            }
+
+            GLState::current().deleteProgram(this->_shaderId);
+            this->_shaderId = 0;
+        }
+
         const char *vertShaderSrc = vertShaderStr.c_str();
         const char *fragShaderSrc = fragShaderStr.c_str();
 
-        GLint result = GL_FALSE;
-        GLint logLength;
+        this->_pendingVertShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(this->_pendingVertShader, 1, &vertShaderSrc, NULL);
+        glCompileShader(this->_pendingVertShader);
 
-        // Compile vertex shader
-        glShaderSource(vertShader, 1, &vertShaderSrc, NULL);
-        glCompileShader(vertShader);
+        this->_pendingFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(this->_pendingFragShader, 1, &fragShaderSrc, NULL);
+        glCompileShader(this->_pendingFragShader);
 
-        // Check vertex shader
-        glGetShaderiv(vertShader, GL_COMPILE_STATUS, &result);
-        if (result == GL_FALSE)
-        {
-            glGetShaderiv(vertShader, GL_INFO_LOG_LENGTH, &logLength);
-            std::vector<GLchar> vertShaderError(static_cast<size_t>((logLength > 1) ? logLength : 1));
-            glGetShaderInfoLog(vertShader, logLength, NULL, &vertShaderError[0]);
-            std::cout << &vertShaderError[0] << std::endl;
+        this->_shaderId = glCreateProgram();
+        glAttachShader(this->_shaderId, this->_pendingVertShader);
+        glAttachShader(this->_shaderId, this->_pendingFragShader);
+        if (!this->_pendingCacheKey.empty()) glProgramParameteri(this->_shaderId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        for (auto& binding : this->_attributeBindings) glBindAttribLocation(this->_shaderId, binding.second, binding.first.c_str());
+        glLinkProgram(this->_shaderId);
 
+        return true;
+    }
+
+    // Without KHR_parallel_shader_compile this is always true and finish() may block
+    bool isReady(bool parallelCompile) const
+    {
+        if (!parallelCompile || this->_shaderId == 0 || this->_pendingFromCache) return true;
+
+        GLint completed = GL_TRUE;
+        glGetProgramiv(this->_shaderId, GL_COMPLETION_STATUS_KHR, &completed);
+
+        return completed == GL_TRUE;
+    }
+
+    // Checks the compile and link status of the submitted program. The shader objects are always
+    // released, the program is deleted when anything failed.
+    bool finish()
+    {
+        auto vertShader = this->_pendingVertShader;
+        auto fragShader = this->_pendingFragShader;
+        this->_pendingVertShader = this->_pendingFragShader = 0;
+
+        if (this->_shaderId == 0)
             return false;
+
+        if (!this->_pendingFromCache)
+        {
+            auto result = checkShader(vertShader) && checkShader(fragShader) && checkProgram(this->_shaderId);
+
+            glDetachShader(this->_shaderId, vertShader);
+            glDetachShader(this->_shaderId, fragShader);
+            glDeleteShader(vertShader);
+            glDeleteShader(fragShader);
+
+            if (!result)
+            {
+                GLState::current().deleteProgram(this->_shaderId);
+                this->_shaderId = 0;
+
+                return false;
+            }
+
+            if (!this->_pendingCacheKey.empty()) this->_binaryCache->store(this->_shaderId, this->_pendingCacheKey);
         }
 
-        // Compile fragment shader
-        glShaderSource(fragShader, 1, &fragShaderSrc, NULL);
-        glCompileShader(fragShader);
+        this->reflect();
+
+        return this->linked();
+    }
+
+    // Called after a successful link, override this to look up uniforms
+    virtual bool linked() { return true; }
+
+    // Called before linking, override this to fix attribute locations with bindAttribute()
+    virtual void bindAttributes() { }
+
+    // Binds the attribute to location when the program is linked
+    void bindAttribute(const std::string& name, GLuint location)
+    {
+        if (!name.empty()) this->_attributeBindings.push_back(std::make_pair(name, location));
+    }
+
+    // Binds every named attribute to its index, so all programs with the same vertex layout agree on the
+    // locations and can share a vertex array
+    void bindAttributeNames(const std::string* names[], size_t count)
+    {
+        for (size_t i = 0; i < count; i++) this->bindAttribute(*names[i], GLuint(i));
+    }
+
+    static bool checkShader(GLuint shader)
+    {
+        GLint result = GL_FALSE;
+        GLint logLength;
 
-        // Check fragment shader
-        glGetShaderiv(fragShader, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
         if (result == GL_FALSE)
         {
-            glGetShaderiv(fragShader, GL_INFO_LOG_LENGTH, &logLength);
-            std::vector<GLchar> fragShaderError(static_cast<size_t>((logLength > 1) ? logLength : 1));
-            glGetShaderInfoLog(fragShader, logLength, NULL, &fragShaderError[0]);
-            std::cout << &fragShaderError[0] << std::endl;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+            std::vector<GLchar> shaderError(static_cast<size_t>((logLength > 1) ? logLength : 1));
+            glGetShaderInfoLog(shader, logLength, NULL, &shaderError[0]);
+            std::cout << &shaderError[0] << std::endl;
 
             return false;
         }
 
-        this->_shaderId = glCreateProgram();
-        glAttachShader(this->_shaderId, vertShader);
-        glAttachShader(this->_shaderId, fragShader);
-        glLinkProgram(this->_shaderId);
+        return true;
+    }
+
+    static bool checkProgram(GLuint program)
+    {
+        GLint result = GL_FALSE;
+        GLint logLength;
 
-        glGetProgramiv(this->_shaderId, GL_LINK_STATUS, &result);
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
         if (result == GL_FALSE)
         {
-            glGetProgramiv(this->_shaderId, GL_INFO_LOG_LENGTH, &logLength);
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
             std::vector<GLchar> programError(static_cast<size_t>((logLength > 1) ? logLength : 1));
-            glGetProgramInfoLog(this->_shaderId, logLength, NULL, &programError[0]);
+            glGetProgramInfoLog(program, logLength, NULL, &programError[0]);
             std::cout << &programError[0] << std::endl;
 
             return false;
         }
 
-        glDeleteShader(vertShader);
-        glDeleteShader(fragShader);
-
         return true;
     }
 
     void use() const
     {
-        glUseProgram(this->_shaderId);
+        GLState::current().useProgram(this->_shaderId);
     }
 };
 
-// Shaders with Projection, View and Model uniforms
+// Shaders with Projection, View and Model uniforms. When the program declares the Camera and Draw
+// blocks instead (see CameraBlock and DrawBlock) they are bound to CameraUniformBinding and
+// DrawUniformBinding after linking. The camera is then uploaded once per frame by a CameraUniformBuffer
+// and the model matrices are pushed into a UniformRingBuffer, so a draw only binds its range.
 class PVMShader : public CompiledShader
 {
 public:
     GLuint _projectionUniformId;
     GLuint _viewUniformId;
     GLuint _modelUniformId;
+    bool _cameraBlock;
+    bool _drawBlock;
 
     PVMShader()
-        : CompiledShader(), _projectionUniformId(0), _viewUniformId(0), _modelUniformId(0),
-          _projectionUniformName("u_projection"), _viewUniformName("u_view"), _modelUniformName("u_model")
+        : CompiledShader(), _projectionUniformId(0), _viewUniformId(0), _modelUniformId(0), _cameraBlock(false), _drawBlock(false),
+          _projectionUniformName("u_projection"), _viewUniformName("u_view"), _modelUniformName("u_model"),
+          _cameraBlockName("Camera"), _drawBlockName("Draw")
     { }
     virtual ~PVMShader() { }
 
     std::string _projectionUniformName;
     std::string _viewUniformName;
     std::string _modelUniformName;
+    std::string _cameraBlockName;
+    std::string _drawBlockName;
 
-    virtual bool compile(const std::string& vertShaderStr, const std::string& fragShaderStr)
+    virtual bool linked()
     {
-        if (!CompiledShader::compile(vertShaderStr, fragShaderStr))
+        if (!CompiledShader::linked())
             return false;
 
         this->_projectionUniformId = glGetUniformLocation(this->_shaderId, this->_projectionUniformName.c_str());
         this->_viewUniformId = glGetUniformLocation(this->_shaderId, this->_viewUniformName.c_str());
         this->_modelUniformId = glGetUniformLocation(this->_shaderId, this->_modelUniformName.c_str());
+        this->_cameraBlock = this->bindUniformBlock(this->_cameraBlockName, CameraUniformBinding);
+        this->_drawBlock = this->bindUniformBlock(this->_drawBlockName, DrawUniformBinding);
 
         return true;
     }
 
+    bool usesUniformBlocks() const { return this->_cameraBlock && this->_drawBlock; }
+
+    // Copies the model matrix into the ring for setupMatrices(ring, offset), call this between the
+    // ring's begin() and flush(). Returns -1 when the ring is full.
+    static GLintptr pushModel(UniformRingBuffer& ring, const float model[])
+    {
+        return ring.push(model, sizeof(DrawBlock));
+    }
+
+    // Binds the model matrix pushed at offset, projection and view come from the Camera block
+    void setupMatrices(const UniformRingBuffer& ring, GLintptr offset)
+    {
+        this->use();
+        ring.bind(offset, sizeof(DrawBlock), DrawUniformBinding);
+    }
+
     void setupMatrices(const float projection[], const float view[], const float model[])
     {
         this->use();
 
-        glUniformMatrix4fv(this->_projectionUniformId, 1, false, projection);
-        glUniformMatrix4fv(this->_viewUniformId, 1, false, view);
-        glUniformMatrix4fv(this->_modelUniformId, 1, false, model);
+        this->setUniformMatrix4fv(GLint(this->_projectionUniformId), projection);
+        this->setUniformMatrix4fv(GLint(this->_viewUniformId), view);
+        this->setUniformMatrix4fv(GLint(this->_modelUniformId), model);
     }
 
     void setupMatrices(const float projectionView[], const float model[])
     {
         this->use();
 
-        glUniformMatrix4fv(this->_projectionUniformId, 1, false, projectionView);
-        glUniformMatrix4fv(this->_modelUniformId, 1, false, model);
+        this->setUniformMatrix4fv(GLint(this->_projectionUniformId), projectionView);
+        this->setUniformMatrix4fv(GLint(this->_modelUniformId), model);
     }
 };
 
@@ -170,13 +524,14 @@ public:
 
     std::string _textureUniformName;
 
-    virtual bool compile(const std::string& vertShaderStr, const std::string& fragShaderStr)
+    virtual bool linked()
     {
-        if (!PVMShader::compile(vertShaderStr, fragShaderStr))
+        if (!PVMShader::linked())
             return false;
 
         this->_textureUniformId = glGetUniformLocation(this->_shaderId, this->_textureUniformName.c_str());
-        glUniform1i(this->_textureUniformId, 0);
+        this->use();
+        this->setUniform1i(GLint(this->_textureUniformId), 0);
 
         return true;
     }
@@ -197,17 +552,20 @@ public:
     std::string _vertexAttributeName;
     std::string _colorAttributeName;
 
-    void setupAttributes() const
+    virtual void bindAttributes()
     {
-        auto vertexSize = sizeof(PositionType) + sizeof(ColorType);
+        PVMShader::bindAttributes();
 
-        auto vertexAttrib = glGetAttribLocation(this->_shaderId, this->_vertexAttributeName.c_str());
-        glVertexAttribPointer(GLuint(vertexAttrib), sizeof(PositionType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
-        glEnableVertexAttribArray(GLuint(vertexAttrib));
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_colorAttributeName };
+        this->bindAttributeNames(names, 2);
+    }
 
-        auto colorAttrib = glGetAttribLocation(this->_shaderId, this->_colorAttributeName.c_str());
-        glVertexAttribPointer(GLuint(colorAttrib), sizeof(ColorType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType)));
-        glEnableVertexAttribArray(GLuint(colorAttrib));
+    // The layout defaults to the attribute types, pass another layout when the buffer holds packed data
+    template <class Layout = VertexLayout<PositionType, ColorType>>
+    void setupAttributes() const
+    {
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_colorAttributeName };
+        Layout::setupAttributes(this->_shaderId, names);
     }
 };
 
@@ -226,21 +584,20 @@ public:
     std::string _normalAttributeName;
     std::string _texcoordAttributeName;
 
-    void setupAttributes() const
+    virtual void bindAttributes()
     {
-        auto vertexSize = sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType);
-
-        GLuint vertexAttrib = glGetAttribLocation(this->_shaderId, this->_vertexAttributeName.c_str());
-        glVertexAttribPointer(vertexAttrib, sizeof(PositionType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
-        glEnableVertexAttribArray(vertexAttrib);
+        TextureShader::bindAttributes();
 
-        GLuint normalAttrib = glGetAttribLocation(this->_shaderId, this->_normalAttributeName.c_str());
-        glVertexAttribPointer(normalAttrib, sizeof(NormalType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType)));
-        glEnableVertexAttribArray(normalAttrib);
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName };
+        this->bindAttributeNames(names, 3);
+    }
 
-        GLuint texcoordAttrib = glGetAttribLocation(this->_shaderId, this->_texcoordAttributeName.c_str());
-        glVertexAttribPointer(texcoordAttrib, sizeof(TexcoordType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType)));
-        glEnableVertexAttribArray(texcoordAttrib);
+    // The layout defaults to the attribute types, pass another layout when the buffer holds packed data
+    template <class Layout = VertexLayout<PositionType, NormalType, TexcoordType>>
+    void setupAttributes() const
+    {
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName };
+        Layout::setupAttributes(this->_shaderId, names);
     }
 };
 
@@ -260,68 +617,231 @@ public:
     std::string _texcoordAttributeName;
     std::string _colorAttributeName;
 
+    virtual void bindAttributes()
+    {
+        TextureShader::bindAttributes();
+
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName, &this->_colorAttributeName };
+        this->bindAttributeNames(names, 4);
+    }
+
+    // The layout defaults to the attribute types, pass another layout when the buffer holds packed data
+    template <class Layout = VertexLayout<PositionType, NormalType, TexcoordType, ColorType>>
     void setupAttributes() const
     {
-        auto vertexSize = sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType) + sizeof(ColorType);
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName, &this->_colorAttributeName };
+        Layout::setupAttributes(this->_shaderId, names);
+    }
+};
+
+// Per instance data for InstancedShader, the model matrix is read from four vec4 attributes. Use
+// InstanceData to also give every instance a color and a texcoord offset (xy) and scale (zw).
+struct InstanceTransform
+{
+    float model[16];
+};
+
+struct InstanceData
+{
+    float model[16];
+    float color[4];
+    float uvOffset[4];
+};
 
-        GLuint vertexAttrib = glGetAttribLocation(this->_shaderId, this->_vertexAttributeName.c_str());
-        glVertexAttribPointer(vertexAttrib, sizeof(PositionType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
-        glEnableVertexAttribArray(vertexAttrib);
+// Offsets of the optional instance attributes, specialize this for your own instance types
+template <class InstanceType>
+struct InstanceAttributes
+{
+    static constexpr int colorOffset = -1;
+    static constexpr int uvOffsetOffset = -1;
+};
+
+template <>
+struct InstanceAttributes<InstanceData>
+{
+    static constexpr int colorOffset = int(offsetof(InstanceData, color));
+    static constexpr int uvOffsetOffset = int(offsetof(InstanceData, uvOffset));
+};
+
+// Shader that reads the model matrix (and optionally color and texcoord offset) per instance from
+// attributes instead of a uniform, see RenderableBuffer::setupInstances. The instance attributes are
+// bound to the fixed locations below and the vertex attributes (through LayoutShader) to their index,
+// so the vertex array set up for the buffer's own shader can be drawn with this program.
+class InstancedShader : public TextureShader
+{
+public:
+    static const GLuint InstanceModelLocation = 10;
+    static const GLuint InstanceColorLocation = 14;
+    static const GLuint InstanceUvOffsetLocation = 15;
+
+    InstancedShader()
+        : _instanceModelAttributeName("instance_model"), _instanceColorAttributeName("instance_color"),
+          _instanceUvOffsetAttributeName("instance_uvoffset")
+    { }
+    virtual ~InstancedShader() { }
 
-        GLuint normalAttrib = glGetAttribLocation(this->_shaderId, this->_normalAttributeName.c_str());
-        glVertexAttribPointer(normalAttrib, sizeof(NormalType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType)));
-        glEnableVertexAttribArray(normalAttrib);
+    std::string _instanceModelAttributeName;
+    std::string _instanceColorAttributeName;
+    std::string _instanceUvOffsetAttributeName;
 
-        GLuint texcoordAttrib = glGetAttribLocation(this->_shaderId, this->_texcoordAttributeName.c_str());
-        glVertexAttribPointer(texcoordAttrib, sizeof(TexcoordType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType)));
-        glEnableVertexAttribArray(texcoordAttrib);
+    virtual void bindAttributes()
+    {
+        TextureShader::bindAttributes();
 
-        GLuint colorAttrib = glGetAttribLocation(this->_shaderId, this->_colorAttributeName.c_str());
-        glVertexAttribPointer(colorAttrib, sizeof(ColorType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType)));
-        glEnableVertexAttribArray(colorAttrib);
+        this->bindAttribute(this->_instanceModelAttributeName, InstanceModelLocation);
+        this->bindAttribute(this->_instanceColorAttributeName, InstanceColorLocation);
+        this->bindAttribute(this->_instanceUvOffsetAttributeName, InstanceUvOffsetLocation);
+    }
+
+    using PVMShader::setupMatrices;
+
+    void setupMatrices(const float projection[], const float view[])
+    {
+        this->use();
+
+        this->setUniformMatrix4fv(GLint(this->_projectionUniformId), projection);
+        this->setUniformMatrix4fv(GLint(this->_viewUniformId), view);
+    }
+
+    // Sets up the instance attributes for the bound vertex array and GL_ARRAY_BUFFER
+    template <class InstanceType>
+    void setupInstanceAttributes() const
+    {
+        auto stride = GLsizei(sizeof(InstanceType));
+
+        auto modelAttrib = glGetAttribLocation(this->_shaderId, this->_instanceModelAttributeName.c_str());
+        for (GLint column = 0; modelAttrib >= 0 && column < 4; column++)
+        {
+            glVertexAttribPointer(GLuint(modelAttrib + column), 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid*>(sizeof(float) * 4 * size_t(column)));
+            glEnableVertexAttribArray(GLuint(modelAttrib + column));
+            glVertexAttribDivisor(GLuint(modelAttrib + column), 1);
+        }
+
+        setupInstanceAttribute(glGetAttribLocation(this->_shaderId, this->_instanceColorAttributeName.c_str()), stride, InstanceAttributes<InstanceType>::colorOffset);
+        setupInstanceAttribute(glGetAttribLocation(this->_shaderId, this->_instanceUvOffsetAttributeName.c_str()), stride, InstanceAttributes<InstanceType>::uvOffsetOffset);
+    }
+
+    static void setupInstanceAttribute(GLint location, GLsizei stride, int offset)
+    {
+        if (location < 0 || offset < 0) return;
+
+        glVertexAttribPointer(GLuint(location), 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid*>(size_t(offset)));
+        glEnableVertexAttribArray(GLuint(location));
+        glVertexAttribDivisor(GLuint(location), 1);
     }
 };
 
+// Bone palettes are written to a fresh offset in a ring of fenced regions, so several characters can
+// share the shader within a frame without the driver stalling on one buffer. With a compact palette
+// every bone is sent as the three rows of its affine 3x4 matrix (vec4 u_bones[3 * N] in the shader),
+// which is 25% less to upload than full 4x4 matrices.
 class SkinnedShader : public TextureShader
 {
     GLuint _bonesUniformId;
-    GLuint _bonesBufferId;
+    UniformRingBuffer _palettes;
+    std::vector<float> _compactBones;
 public:
     SkinnedShader()
-        : _bonesUniformId(0), _bonesBufferId(0),
+        : _bonesUniformId(BonesUniformBinding), _maxBoneCount(64), _palettesPerFrame(64), _compactPalette(false),
           _bonesBlockUniformName("u_bones")
     { }
     virtual ~SkinnedShader() { }
 
+    // Size of the bone buffer, set these before handing the shader to ShaderCompiler
+    int _maxBoneCount;
+    int _palettesPerFrame;
+    bool _compactPalette;
     std::string _bonesBlockUniformName;
 
-    virtual bool compile(const std::string& vertShaderStr, const std::string& fragShaderStr, int maxBoneCount)
+    int bytesPerBone() const { return int(sizeof(float) * (this->_compactPalette ? 12 : 16)); }
+
+    virtual bool compile(const std::string& vertShaderStr, const std::string& fragShaderStr, int maxBoneCount, int palettesPerFrame = 64, bool compactPalette = false)
     {
-        if (!PVMShader::compile(vertShaderStr, fragShaderStr))
+        this->_maxBoneCount = maxBoneCount;
+        this->_palettesPerFrame = palettesPerFrame;
+        this->_compactPalette = compactPalette;
+
+        return PVMShader::compile(vertShaderStr, fragShaderStr);
+    }
+
+    // Binds the bone block and (re)creates the bone buffer, also when the program came from ShaderCompiler
+    virtual bool linked()
+    {
+        if (!TextureShader::linked())
             return false;
 
-        this->_bonesUniformId = 0;
+        this->_bonesUniformId = BonesUniformBinding;
         GLint uniform_block_index = glGetUniformBlockIndex(this->_shaderId, this->_bonesBlockUniformName.c_str());
         glUniformBlockBinding(this->_shaderId, uniform_block_index, this->_bonesUniformId);
 
-        glGenBuffers(1, &this->_bonesBufferId);
-
-        glBindBuffer(GL_UNIFORM_BUFFER, this->_bonesBufferId);
-        glBufferData(GL_UNIFORM_BUFFER, maxBoneCount * sizeof(float) * 16, 0, GL_STREAM_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        auto paletteSize = (size_t(this->_maxBoneCount * this->bytesPerBone()) + size_t(alignment) - 1) / size_t(alignment) * size_t(alignment);
+        this->_palettes.cleanup();
+        this->_palettes.setup(paletteSize * size_t(this->_palettesPerFrame), false);
 
         return true;
     }
 
-    void setupBones(const float boneMatrices[][16], int boneCount)
+    // Returns false when the palette does not fit in the bone buffer, nothing is bound then
+    bool setupBones(const float boneMatrices[][16], int boneCount)
     {
         this->use();
 
-        glBindBuffer(GL_UNIFORM_BUFFER, this->_bonesBufferId);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, boneCount * sizeof(float) * 16, boneMatrices);
-        glBindBufferRange(GL_UNIFORM_BUFFER, this->_bonesUniformId, this->_bonesBufferId, 0, boneCount * sizeof(float) * 16);
+        const void* palette = boneMatrices;
+        if (this->_compactPalette)
+        {
+            this->_compactBones.resize(size_t(boneCount) * 12);
+            for (int bone = 0; bone < boneCount; bone++)
+            {
+                auto target = &this->_compactBones[size_t(bone) * 12];
+                for (int row = 0; row < 3; row++)
+                {
+                    for (int column = 0; column < 4; column++) target[row * 4 + column] = boneMatrices[bone][column * 4 + row];
+                }
+            }
+            palette = this->_compactBones.data();
+        }
+
+        auto size = size_t(boneCount * this->bytesPerBone());
+        auto offset = this->_palettes.push(palette, size);
+        if (offset < 0 && size <= this->_palettes.regionSize())
+        {
+            this->_palettes.begin();
+            offset = this->_palettes.push(palette, size);
+        }
+
+        if (offset < 0)
+        {
+            std::cout << "Unable to push a palette of " << boneCount << " bones, the bone buffer holds " << this->_maxBoneCount << std::endl;
+            return false;
+        }
+
+        this->_palettes.bind(offset, size, this->_bonesUniformId);
+
+        return true;
+    }
+
+    // Reserves a palette in the mapped bone buffer to be filled by PaletteEvaluator, returns nullptr when
+    // the buffer is not persistently mapped, use setupBones() then
+    float* reservePalette(int boneCount, GLintptr& offset)
+    {
+        void* target = nullptr;
+        offset = this->_palettes.reserve(size_t(boneCount * this->bytesPerBone()), target);
+
+        return reinterpret_cast<float*>(target);
     }
 
+    void bindPalette(GLintptr offset, int boneCount)
+    {
+        this->use();
+        this->_palettes.bind(offset, size_t(boneCount * this->bytesPerBone()), this->_bonesUniformId);
+    }
+
+    void cleanup()
+    {
+        this->_palettes.cleanup();
+    }
 };
 
 template <class PositionType, class NormalType, class TexcoordType, class ColorType, class BoneType>
@@ -342,29 +862,52 @@ public:
     std::string _colorAttributeName;
     std::string _boneAttributeName;
 
+    virtual void bindAttributes()
+    {
+        SkinnedShader::bindAttributes();
+
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName, &this->_colorAttributeName, &this->_boneAttributeName };
+        this->bindAttributeNames(names, 5);
+    }
+
+    // The layout defaults to the attribute types, pass another layout when the buffer holds packed data
+    template <class Layout = VertexLayout<PositionType, NormalType, TexcoordType, ColorType, BoneType>>
     void setupAttributes() const
     {
-        auto vertexSize = sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType) + sizeof(ColorType) + sizeof(BoneType);
+        const std::string* names[] = { &this->_vertexAttributeName, &this->_normalAttributeName, &this->_texcoordAttributeName, &this->_colorAttributeName, &this->_boneAttributeName };
+        Layout::setupAttributes(this->_shaderId, names);
+    }
+};
 
-        GLuint vertexAttrib = glGetAttribLocation(this->_shaderId, this->_vertexAttributeName.c_str());
-        glVertexAttribPointer(vertexAttrib, sizeof(PositionType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
-        glEnableVertexAttribArray(vertexAttrib);
+// Shader for any vertex layout, set the attribute names by index in the order of the types. Only named
+// attributes are bound to their index before linking, so with InstancedShader as the base every vertex
+// attribute needs its name to share the vertex array of the buffer's own shader.
+template <class BaseShader, class... Types>
+class LayoutShader : public BaseShader
+{
+public:
+    typedef VertexLayout<Types...> layout;
+
+    LayoutShader() { }
+    virtual ~LayoutShader() { }
 
-        GLuint normalAttrib = glGetAttribLocation(this->_shaderId, this->_normalAttributeName.c_str());
-        glVertexAttribPointer(normalAttrib, sizeof(NormalType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType)));
-        glEnableVertexAttribArray(normalAttrib);
+    std::string _attributeNames[sizeof...(Types)];
 
-        GLuint texcoordAttrib = glGetAttribLocation(this->_shaderId, this->_texcoordAttributeName.c_str());
-        glVertexAttribPointer(texcoordAttrib, sizeof(TexcoordType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType)));
-        glEnableVertexAttribArray(texcoordAttrib);
+    virtual void bindAttributes()
+    {
+        BaseShader::bindAttributes();
 
-        GLuint colorAttrib = glGetAttribLocation(this->_shaderId, this->_colorAttributeName.c_str());
-        glVertexAttribPointer(colorAttrib, sizeof(ColorType) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType)));
-        glEnableVertexAttribArray(colorAttrib);
+        const std::string* names[sizeof...(Types)];
+        for (size_t i = 0; i < sizeof...(Types); i++) names[i] = &this->_attributeNames[i];
+        this->bindAttributeNames(names, sizeof...(Types));
+    }
 
-        GLuint boneAttrib = glGetAttribLocation(this->_shaderId, this->_boneAttributeName.c_str());
-        glVertexAttribPointer(boneAttrib, sizeof(BoneType) / sizeof(int), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid*>(sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType) + sizeof(ColorType)));
-        glEnableVertexAttribArray(boneAttrib);
+    template <class Layout = layout>
+    void setupAttributes() const
+    {
+        const std::string* names[sizeof...(Types)];
+        for (size_t i = 0; i < sizeof...(Types); i++) names[i] = &this->_attributeNames[i];
+        Layout::setupAttributes(this->_shaderId, names);
     }
 };
 
@@ -0,0 +1,116 @@
+#ifndef GL_UTILITIES_SIMD_H
+#define GL_UTILITIES_SIMD_H
+
+// Define GL_UTILITIES_NO_SIMD to build the scalar fallback, for example to compare against it
+#if defined(GL_UTILITIES_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GL_UTILITIES_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GL_UTILITIES_NEON
+#endif
+
+#if defined(__F16C__) && !defined(GL_UTILITIES_NO_SIMD)
+#include <immintrin.h>
+#define GL_UTILITIES_F16C
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Four float lanes on SSE2 or NEON with a scalar fallback, enough for the kernels in this library
+#if defined(GL_UTILITIES_SSE2)
+struct Float4 { __m128 v; };
+inline Float4 simdLoad(const float* p) { return { _mm_loadu_ps(p) }; }
+inline void simdStore(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 simdSet1(float a) { return { _mm_set1_ps(a) }; }
+inline Float4 simdAdd(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Float4 simdSub(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Float4 simdMul(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Float4 simdMin(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline Float4 simdMax(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+inline Float4 simdMulAdd(Float4 a, Float4 b, Float4 c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+inline int simdMaskLessThan(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+inline Float4 simdSelectLessThan(Float4 a, Float4 b, Float4 c, Float4 d) { auto m = _mm_cmplt_ps(a.v, b.v); return { _mm_or_ps(_mm_and_ps(m, c.v), _mm_andnot_ps(m, d.v)) }; }
+inline Float4 simdDiv(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+inline void simdStoreRounded(int32_t* p, Float4 a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvtps_epi32(a.v)); }
+inline Float4 simdLoadBytes(const unsigned char* p)
+{
+    int32_t word;
+    std::memcpy(&word, p, 4);
+    auto zero = _mm_setzero_si128();
+    return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero)) };
+}
+#elif defined(GL_UTILITIES_NEON)
+struct Float4 { float32x4_t v; };
+inline Float4 simdLoad(const float* p) { return { vld1q_f32(p) }; }
+inline void simdStore(float* p, Float4 a) { vst1q_f32(p, a.v); }
+inline Float4 simdSet1(float a) { return { vdupq_n_f32(a) }; }
+inline Float4 simdAdd(Float4 a, Float4 b) { return { vaddq_f32(a.v, b.v) }; }
+inline Float4 simdSub(Float4 a, Float4 b) { return { vsubq_f32(a.v, b.v) }; }
+inline Float4 simdMul(Float4 a, Float4 b) { return { vmulq_f32(a.v, b.v) }; }
+inline Float4 simdMin(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+inline Float4 simdMax(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+inline Float4 simdMulAdd(Float4 a, Float4 b, Float4 c) { return { vmlaq_f32(c.v, a.v, b.v) }; }
+inline int simdMaskLessThan(Float4 a, Float4 b)
+{
+    uint32_t lanes[4];
+    vst1q_u32(lanes, vcltq_f32(a.v, b.v));
+    return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+}
+inline Float4 simdSelectLessThan(Float4 a, Float4 b, Float4 c, Float4 d) { return { vbslq_f32(vcltq_f32(a.v, b.v), c.v, d.v) }; }
+inline Float4 simdLoadBytes(const unsigned char* p)
+{
+    uint32_t word;
+    std::memcpy(&word, p, 4);
+    return { vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)))))) };
+}
+#if defined(__aarch64__)
+inline Float4 simdDiv(Float4 a, Float4 b) { return { vdivq_f32(a.v, b.v) }; }
+inline void simdStoreRounded(int32_t* p, Float4 a) { vst1q_s32(p, vcvtnq_s32_f32(a.v)); }
+#else
+inline Float4 simdDiv(Float4 a, Float4 b)
+{
+    auto reciprocal = vrecpeq_f32(b.v);
+    reciprocal = vmulq_f32(vrecpsq_f32(b.v, reciprocal), reciprocal);
+    reciprocal = vmulq_f32(vrecpsq_f32(b.v, reciprocal), reciprocal);
+    return { vmulq_f32(a.v, reciprocal) };
+}
+inline void simdStoreRounded(int32_t* p, Float4 a)
+{
+    auto half = vbslq_f32(vcltq_f32(a.v, vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+    vst1q_s32(p, vcvtq_s32_f32(vaddq_f32(a.v, half)));
+}
+#endif
+#else
+struct Float4 { float v[4]; };
+inline Float4 simdLoad(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void simdStore(float* p, Float4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline Float4 simdSet1(float a) { return { { a, a, a, a } }; }
+inline Float4 simdAdd(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline Float4 simdSub(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline Float4 simdMul(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline Float4 simdMin(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline Float4 simdMax(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline Float4 simdMulAdd(Float4 a, Float4 b, Float4 c) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] * b.v[i] + c.v[i]; return a; }
+inline int simdMaskLessThan(Float4 a, Float4 b) { int mask = 0; for (int i = 0; i < 4; i++) mask |= a.v[i] < b.v[i] ? (1 << i) : 0; return mask; }
+inline Float4 simdSelectLessThan(Float4 a, Float4 b, Float4 c, Float4 d) { for (int i = 0; i < 4; i++) c.v[i] = a.v[i] < b.v[i] ? c.v[i] : d.v[i]; return c; }
+inline Float4 simdDiv(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline void simdStoreRounded(int32_t* p, Float4 a) { for (int i = 0; i < 4; i++) p[i] = int32_t(std::lrint(a.v[i])); }
+inline Float4 simdLoadBytes(const unsigned char* p) { return { { float(p[0]), float(p[1]), float(p[2]), float(p[3]) } }; }
+#endif
+
+// Column major 4x4 product, result = a * b. The result may be the same matrix as b.
+inline void simdMultiplyMatrices(const float a[], const float b[], float result[])
+{
+    auto c0 = simdLoad(a), c1 = simdLoad(a + 4), c2 = simdLoad(a + 8), c3 = simdLoad(a + 12);
+    for (int column = 0; column < 4; column++)
+    {
+        auto b0 = simdSet1(b[column * 4]), b1 = simdSet1(b[column * 4 + 1]), b2 = simdSet1(b[column * 4 + 2]), b3 = simdSet1(b[column * 4 + 3]);
+        simdStore(result + column * 4, simdMulAdd(c3, b3, simdMulAdd(c2, b2, simdMulAdd(c1, b1, simdMul(c0, b0)))));
+    }
+}
+
+#endif // GL_UTILITIES_SIMD_H
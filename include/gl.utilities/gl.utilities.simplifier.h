@@ -0,0 +1,322 @@
+#ifndef GL_UTILITIES_SIMPLIFIER_H
+#define GL_UTILITIES_SIMPLIFIER_H
+
+#include "gl.utilities.meshoptimizer.h"
+#include "gl.utilities.threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+// Simplifies indexed triangle lists with quadric error metrics (Garland and Heckbert 1997). Edges are
+// collapsed onto one of their existing vertices, so every level indexes the same vertex buffer.
+// Vertices on a border or on an attribute seam (several vertices at one position) never move, which
+// keeps holes closed and texture seams intact. Errors are distances relative to the mesh radius.
+class MeshSimplifier
+{
+    static const size_t ParallelIndexCount = 65536;
+
+    struct Quadric
+    {
+        float a00, a01, a02, a11, a12, a22, b0, b1, b2, c, w;
+    };
+
+    struct Collapse
+    {
+        float cost;
+        unsigned int from;
+        unsigned int to;
+    };
+
+    std::vector<float> _positions;
+    std::vector<Quadric> _quadrics;
+    std::vector<bool> _locked;
+    float _center[3];
+    float _radius;
+
+    const float* position(unsigned int vertex) const { return &this->_positions[size_t(vertex) * 3]; }
+
+    static void normal(const float* p0, const float* p1, const float* p2, float* result)
+    {
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        result[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        result[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        result[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    static void addPlane(Quadric& q, const float* p0, const float* p1, const float* p2)
+    {
+        float n[3];
+        normal(p0, p1, p2, n);
+        auto length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length <= 0.0f) return;
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        auto d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        auto w = length * 0.5f;
+
+        q.a00 += w * n[0] * n[0]; q.a01 += w * n[0] * n[1]; q.a02 += w * n[0] * n[2];
+        q.a11 += w * n[1] * n[1]; q.a12 += w * n[1] * n[2]; q.a22 += w * n[2] * n[2];
+        q.b0 += w * n[0] * d; q.b1 += w * n[1] * d; q.b2 += w * n[2] * d;
+        q.c += w * d * d;
+        q.w += w;
+    }
+
+    static void add(Quadric& target, const Quadric& q)
+    {
+        target.a00 += q.a00; target.a01 += q.a01; target.a02 += q.a02;
+        target.a11 += q.a11; target.a12 += q.a12; target.a22 += q.a22;
+        target.b0 += q.b0; target.b1 += q.b1; target.b2 += q.b2;
+        target.c += q.c;
+        target.w += q.w;
+    }
+
+    // Area weighted mean squared distance of p to the planes of both quadrics
+    static float cost(const Quadric& a, const Quadric& b, const float* p)
+    {
+        auto x = p[0], y = p[1], z = p[2];
+        auto value =
+            (a.a00 + b.a00) * x * x + (a.a11 + b.a11) * y * y + (a.a22 + b.a22) * z * z +
+            2.0f * ((a.a01 + b.a01) * x * y + (a.a02 + b.a02) * x * z + (a.a12 + b.a12) * y * z) +
+            2.0f * ((a.b0 + b.b0) * x + (a.b1 + b.b1) * y + (a.b2 + b.b2) * z) +
+            (a.c + b.c);
+        auto weight = a.w + b.w;
+
+        return weight > 0.0f && value > 0.0f ? value / weight : 0.0f;
+    }
+
+    // Moving from onto to must not turn any of the remaining triangles around from over
+    bool flips(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& adjacency, unsigned int from, unsigned int to) const
+    {
+        for (auto a = offsets[from]; a < offsets[from + 1]; a++)
+        {
+            auto triangle = &indices[size_t(adjacency[a]) * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+            const float* before[3] = { this->position(triangle[0]), this->position(triangle[1]), this->position(triangle[2]) };
+            const float* after[3] = { before[0], before[1], before[2] };
+            for (int corner = 0; corner < 3; corner++) if (triangle[corner] == from) after[corner] = this->position(to);
+
+            float n0[3], n1[3];
+            normal(before[0], before[1], before[2], n0);
+            normal(after[0], after[1], after[2], n1);
+            if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0f) return true;
+        }
+
+        return false;
+    }
+
+public:
+    struct Level
+    {
+        std::vector<unsigned int> indices;
+        float error;
+    };
+
+private:
+    // Collapses the cheapest edges, in passes of independent collapses, until the index count reaches
+    // the target or nothing can be collapsed anymore. The quadrics of collapsed vertices are merged into
+    // the ones they moved onto, so passing them on to the next level keeps measuring against the full mesh.
+    void collapse(const std::vector<unsigned int>& indices, size_t targetIndexCount, std::vector<Quadric>& quadrics, Level& result, ThreadPool* pool) const
+    {
+        auto vertexCount = quadrics.size();
+        std::vector<unsigned int> remap(vertexCount), offsets, adjacency, collapsed;
+        std::vector<char> touched;
+        std::vector<Collapse> candidates;
+        std::iota(remap.begin(), remap.end(), 0u);
+
+        result.indices.assign(indices.begin(), indices.begin() + long(indices.size() / 3 * 3));
+        float error = 0.0f;
+        while (result.indices.size() > targetIndexCount)
+        {
+            auto& current = result.indices;
+
+            offsets.assign(vertexCount + 1, 0);
+            for (auto v : current) offsets[v + 1]++;
+            for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+            adjacency.resize(current.size());
+            {
+                auto fill = offsets;
+                for (size_t i = 0; i < current.size(); i++) adjacency[fill[current[i]]++] = unsigned(i / 3);
+            }
+
+            // Every corner gives the two directions of one edge, locked vertices get an infinite cost
+            candidates.resize(current.size() * 2);
+            auto evaluate = [this, &current, &quadrics, &candidates] (size_t begin, size_t end)
+            {
+                for (auto i = begin; i < end; i++)
+                {
+                    auto a = current[i], b = current[i - i % 3 + (i + 1) % 3];
+                    auto infinite = std::numeric_limits<float>::infinity();
+                    candidates[i * 2] = { this->_locked[a] ? infinite : cost(quadrics[a], quadrics[b], this->position(b)), a, b };
+                    candidates[i * 2 + 1] = { this->_locked[b] ? infinite : cost(quadrics[a], quadrics[b], this->position(a)), b, a };
+                }
+            };
+            if (pool != nullptr && pool->size() > 0 && current.size() >= ParallelIndexCount) pool->parallelFor(current.size(), 16384, evaluate);
+            else evaluate(0, current.size());
+
+            // Only the cheapest few are needed, most get rejected for touching an earlier collapse
+            size_t removed = 0, needed = (current.size() - targetIndexCount) / 3;
+            auto compare = [] (const Collapse& a, const Collapse& b) { return a.cost < b.cost; };
+            auto selected = std::min(candidates.size(), std::max(needed * 8, size_t(1024)));
+            std::nth_element(candidates.begin(), candidates.begin() + long(selected - 1), candidates.end(), compare);
+            candidates.resize(selected);
+            std::sort(candidates.begin(), candidates.end(), compare);
+
+            // Collapses whose neighbourhoods do not overlap can be applied together
+            touched.assign(vertexCount, 0);
+            collapsed.clear();
+            for (auto& candidate : candidates)
+            {
+                if (removed >= needed || candidate.cost == std::numeric_limits<float>::infinity()) break;
+                if (touched[candidate.from] || touched[candidate.to]) continue;
+                if (this->flips(current, offsets, adjacency, candidate.from, candidate.to)) continue;
+
+                for (auto a = offsets[candidate.from]; a < offsets[candidate.from + 1]; a++)
+                {
+                    auto triangle = &current[size_t(adjacency[a]) * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                    if (triangle[0] == candidate.to || triangle[1] == candidate.to || triangle[2] == candidate.to) removed++;
+                }
+
+                remap[candidate.from] = candidate.to;
+                add(quadrics[candidate.to], quadrics[candidate.from]);
+                collapsed.push_back(candidate.from);
+                error = std::max(error, candidate.cost);
+            }
+
+            if (collapsed.empty()) break;
+
+            size_t write = 0;
+            for (size_t i = 0; i < current.size(); i += 3)
+            {
+                auto a = remap[current[i]], b = remap[current[i + 1]], c = remap[current[i + 2]];
+                if (a == b || b == c || a == c) continue;
+
+                current[write++] = a;
+                current[write++] = b;
+                current[write++] = c;
+            }
+            current.resize(write);
+            for (auto v : collapsed) remap[v] = v;
+        }
+
+        result.error = this->_radius > 0.0f ? std::sqrt(error) / this->_radius : 0.0f;
+    }
+
+public:
+
+    MeshSimplifier() : _radius(0.0f) { this->_center[0] = this->_center[1] = this->_center[2] = 0.0f; }
+
+    // Collects the positions, quadrics and locked vertices, returns false when the vertex type has no
+    // usable position (see VertexPosition)
+    template <class VertexType>
+    bool prepare(const std::vector<VertexType>& verts, const std::vector<unsigned int>& indices)
+    {
+        if (verts.empty() || VertexPosition<VertexType>::get(verts[0]) == nullptr) return false;
+
+        auto count = verts.size();
+        this->_positions.resize(count * 3);
+        float minimum[3] = { 1e30f, 1e30f, 1e30f }, maximum[3] = { -1e30f, -1e30f, -1e30f };
+        for (size_t v = 0; v < count; v++)
+        {
+            auto p = VertexPosition<VertexType>::get(verts[v]);
+            for (int c = 0; c < 3; c++)
+            {
+                this->_positions[v * 3 + size_t(c)] = p[c];
+                minimum[c] = std::min(minimum[c], p[c]);
+                maximum[c] = std::max(maximum[c], p[c]);
+            }
+        }
+
+        this->_radius = 0.0f;
+        for (int c = 0; c < 3; c++) this->_center[c] = (minimum[c] + maximum[c]) * 0.5f;
+        for (size_t v = 0; v < count; v++)
+        {
+            auto p = this->position(unsigned(v));
+            auto dx = p[0] - this->_center[0], dy = p[1] - this->_center[1], dz = p[2] - this->_center[2];
+            this->_radius = std::max(this->_radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+        }
+
+        // Vertices at the same position form one corner, more than one vertex there means a seam
+        std::vector<unsigned int> order(count), corner(count);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [this] (unsigned int a, unsigned int b)
+        {
+            return std::lexicographical_compare(this->position(a), this->position(a) + 3, this->position(b), this->position(b) + 3);
+        });
+        this->_locked.assign(count, false);
+        for (size_t i = 0; i < count;)
+        {
+            auto j = i + 1;
+            while (j < count && std::equal(this->position(order[i]), this->position(order[i]) + 3, this->position(order[j]))) j++;
+            for (auto k = i; k < j; k++)
+            {
+                corner[order[k]] = order[i];
+                if (j - i > 1) this->_locked[order[k]] = true;
+            }
+            i = j;
+        }
+
+        // Edges between corners without a twin going the other way lie on a border
+        std::vector<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            for (size_t e = 0; e < 3; e++) edges.push_back(uint64_t(corner[indices[i + e]]) << 32 | corner[indices[i + (e + 1) % 3]]);
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            for (size_t e = 0; e < 3; e++)
+            {
+                auto a = indices[i + e], b = indices[i + (e + 1) % 3];
+                if (!std::binary_search(edges.begin(), edges.end(), uint64_t(corner[b]) << 32 | corner[a])) this->_locked[a] = this->_locked[b] = true;
+            }
+        }
+
+        this->_quadrics.assign(count, Quadric());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Quadric q = Quadric();
+            addPlane(q, this->position(indices[i]), this->position(indices[i + 1]), this->position(indices[i + 2]));
+            for (size_t e = 0; e < 3; e++) add(this->_quadrics[indices[i + e]], q);
+        }
+
+        return true;
+    }
+
+    // Simplifies the whole triangles of indices down to targetIndexCount, the collapse costs of large
+    // meshes are evaluated on the pool
+    void simplify(const std::vector<unsigned int>& indices, size_t targetIndexCount, Level& result, ThreadPool* pool = nullptr) const
+    {
+        auto quadrics = this->_quadrics;
+        this->collapse(indices, targetIndexCount, quadrics, result, pool);
+    }
+
+    // Builds levels 1 to levelCount - 1, each continuing from the one before, and its quadrics, with
+    // ratio times its triangles
+    void buildLods(const std::vector<unsigned int>& indices, int levelCount, float ratio, std::vector<Level>& levels, ThreadPool* pool = nullptr) const
+    {
+        levels.assign(size_t(levelCount > 1 ? levelCount - 1 : 0), Level());
+
+        auto quadrics = this->_quadrics;
+        for (size_t level = 0; level < levels.size(); level++)
+        {
+            auto& source = level == 0 ? indices : levels[level - 1].indices;
+            this->collapse(source, size_t(double(source.size() / 3) * double(ratio)) * 3, quadrics, levels[level], pool);
+            if (level > 0) levels[level].error = std::max(levels[level].error, levels[level - 1].error);
+        }
+    }
+
+    const float* center() const { return this->_center; }
+    float radius() const { return this->_radius; }
+};
+
+#endif // GL_UTILITIES_SIMPLIFIER_H
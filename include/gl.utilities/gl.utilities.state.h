@@ -0,0 +1,225 @@
+#ifndef GL_UTILITIES_STATE_H
+#define GL_UTILITIES_STATE_H
+
+#ifdef _WIN32
+#include <glad/glad.h>
+#endif // _WIN32
+
+#ifdef __ANDROID__
+#include <GLES/gl.h>
+#include <GLES3/gl3.h>
+#endif // __ANDROID__
+
+// Tracks the bound program, vertex array, buffers and textures of the context current on this thread,
+// so binding what is already bound does not reach the driver. Call invalidate() after code outside of
+// this library changed any of these bindings.
+class GLState
+{
+    static const int MaxTextureUnits = 32;
+    static const int MaxBufferRanges = 16;
+    static const GLuint Unknown = ~0u;
+
+    enum BufferSlot { ArrayBuffer, ElementArrayBuffer, UniformBuffer, DrawIndirectBuffer, PixelUnpackBuffer, PixelPackBuffer, BufferSlotCount };
+    enum TextureSlot { Texture2D, Texture2DArray, TextureCubeMap, Texture3D, TextureSlotCount };
+
+    struct BufferRange
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    GLuint _program;
+    GLuint _vertexArray;
+    GLuint _buffers[BufferSlotCount];
+    BufferRange _uniformRanges[MaxBufferRanges];
+    GLenum _activeTexture;
+    GLuint _textures[MaxTextureUnits][TextureSlotCount];
+    unsigned int _issued;
+    unsigned int _elided;
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER: return ArrayBuffer;
+            case GL_ELEMENT_ARRAY_BUFFER: return ElementArrayBuffer;
+            case GL_UNIFORM_BUFFER: return UniformBuffer;
+#ifdef GL_DRAW_INDIRECT_BUFFER
+            case GL_DRAW_INDIRECT_BUFFER: return DrawIndirectBuffer;
+#endif
+            case GL_PIXEL_UNPACK_BUFFER: return PixelUnpackBuffer;
+            case GL_PIXEL_PACK_BUFFER: return PixelPackBuffer;
+            default: return -1;
+        }
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D: return Texture2D;
+            case GL_TEXTURE_2D_ARRAY: return Texture2DArray;
+            case GL_TEXTURE_CUBE_MAP: return TextureCubeMap;
+            case GL_TEXTURE_3D: return Texture3D;
+            default: return -1;
+        }
+    }
+
+    bool update(GLuint& cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            this->_elided++;
+            return false;
+        }
+
+        cached = value;
+        this->_issued++;
+
+        return true;
+    }
+
+public:
+    GLState() : _issued(0), _elided(0) { this->invalidate(); }
+
+    static GLState& current()
+    {
+        static thread_local GLState state;
+        return state;
+    }
+
+    void invalidate()
+    {
+        this->_program = Unknown;
+        this->_vertexArray = Unknown;
+        this->_activeTexture = Unknown;
+        for (auto& buffer : this->_buffers) buffer = Unknown;
+        for (auto& range : this->_uniformRanges) range.buffer = Unknown;
+        for (auto& unit : this->_textures) for (auto& texture : unit) texture = Unknown;
+    }
+
+    unsigned int issued() const { return this->_issued; }
+    unsigned int elided() const { return this->_elided; }
+    void resetCounters() { this->_issued = this->_elided = 0; }
+
+    void useProgram(GLuint program)
+    {
+        if (this->update(this->_program, program)) glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vertexArray)
+    {
+        if (!this->update(this->_vertexArray, vertexArray)) return;
+
+        glBindVertexArray(vertexArray);
+
+        // The element buffer binding belongs to the vertex array
+        this->_buffers[ElementArrayBuffer] = Unknown;
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        auto slot = bufferSlot(target);
+        if (slot < 0)
+        {
+            this->_issued++;
+            glBindBuffer(target, buffer);
+        }
+        else if (this->update(this->_buffers[slot], buffer))
+        {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    // Binds a range to an indexed binding point, which also changes the generic binding of the target
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        auto slot = bufferSlot(target);
+        if (target == GL_UNIFORM_BUFFER && index < GLuint(MaxBufferRanges))
+        {
+            auto& range = this->_uniformRanges[index];
+            if (range.buffer == buffer && range.offset == offset && range.size == size && this->_buffers[slot] == buffer)
+            {
+                this->_elided++;
+                return;
+            }
+            range.buffer = buffer;
+            range.offset = offset;
+            range.size = size;
+        }
+
+        this->_issued++;
+        glBindBufferRange(target, index, buffer, offset, size);
+        if (slot >= 0) this->_buffers[slot] = buffer;
+    }
+
+    void activeTexture(GLenum unit)
+    {
+        if (this->_activeTexture == unit)
+        {
+            this->_elided++;
+            return;
+        }
+
+        this->_activeTexture = unit;
+        this->_issued++;
+        glActiveTexture(unit);
+    }
+
+    // While the active unit is unknown it is set to the first one once, so binds can be cached per unit
+    void bindTexture(GLenum target, GLuint texture)
+    {
+        if (this->_activeTexture == Unknown) this->activeTexture(GL_TEXTURE0);
+
+        auto unit = int(this->_activeTexture - GL_TEXTURE0);
+        auto slot = textureSlot(target);
+        if (slot < 0 || unit >= MaxTextureUnits)
+        {
+            this->_issued++;
+            glBindTexture(target, texture);
+        }
+        else if (this->update(this->_textures[unit][slot], texture))
+        {
+            glBindTexture(target, texture);
+        }
+    }
+
+    void bindTexture(GLenum target, GLuint texture, int unit)
+    {
+        this->activeTexture(GLenum(GL_TEXTURE0 + unit));
+        this->bindTexture(target, texture);
+    }
+
+    // Deleted names can be handed out again, so they have to be forgotten
+    void deleteProgram(GLuint program)
+    {
+        if (this->_program == program) this->_program = Unknown;
+        glDeleteProgram(program);
+    }
+
+    void deleteVertexArray(GLuint vertexArray)
+    {
+        if (this->_vertexArray == vertexArray)
+        {
+            this->_vertexArray = Unknown;
+            this->_buffers[ElementArrayBuffer] = Unknown;
+        }
+        glDeleteVertexArrays(1, &vertexArray);
+    }
+
+    void deleteBuffer(GLuint buffer)
+    {
+        for (auto& cached : this->_buffers) if (cached == buffer) cached = Unknown;
+        for (auto& range : this->_uniformRanges) if (range.buffer == buffer) range.buffer = Unknown;
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void deleteTexture(GLuint texture)
+    {
+        for (auto& unit : this->_textures) for (auto& cached : unit) if (cached == texture) cached = Unknown;
+        glDeleteTextures(1, &texture);
+    }
+};
+
+#endif // GL_UTILITIES_STATE_H
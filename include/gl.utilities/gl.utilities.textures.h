@@ -10,19 +10,25 @@
 #include <GLES3/gl3.h>
 #endif // __ANDROID__
 
+#include <functional>
 #include <string>
 #include <iostream>
 
+#include "gl.utilities.residency.h"
+#include "gl.utilities.state.h"
+
 class Texture
 {
     friend class TextureLoader;
     GLuint _textureId;
     int _width;
     int _height;
+    ResidencyManager* _residency;
+    ResidencyManager::Handle _residencyHandle;
 public:
-    Texture() : _textureId(0) { }
-    Texture(GLuint id) : _textureId(id) { }
-    virtual ~Texture() { this->cleanup(); }
+    Texture() : _textureId(0), _residency(nullptr), _residencyHandle(0) { }
+    Texture(GLuint id) : _textureId(id), _residency(nullptr), _residencyHandle(0) { }
+    virtual ~Texture() { this->untrack(); this->cleanup(); }
 
     void setup()
     {
@@ -31,7 +37,40 @@ public:
 
     void use() const
     {
-        glBindTexture(GL_TEXTURE_2D, this->_textureId);
+        if (this->_residency != nullptr) this->_residency->touch(this->_residencyHandle);
+        GLState::current().bindTexture(GL_TEXTURE_2D, this->_textureId);
+    }
+
+    void use(int unit) const
+    {
+        if (this->_residency != nullptr) this->_residency->touch(this->_residencyHandle);
+        GLState::current().bindTexture(GL_TEXTURE_2D, this->_textureId, unit);
+    }
+
+    // Lets the manager evict the loaded texture, reload is called with a fresh texture name on the
+    // next use and should load it again, for example with TextureLoader
+    void track(ResidencyManager& manager, std::function<bool(Texture&)> reload, float bytesPerPixel = 4.0f, bool mipmapped = true)
+    {
+        this->untrack();
+        this->_residency = &manager;
+        this->_residencyHandle = manager.add(
+            ResidencyManager::textureBytes(this->_width, this->_height, bytesPerPixel, mipmapped),
+            [this, reload, bytesPerPixel, mipmapped] ()
+            {
+                this->setup();
+                if (!reload(*this)) return false;
+                this->_residency->resize(this->_residencyHandle, ResidencyManager::textureBytes(this->_width, this->_height, bytesPerPixel, mipmapped));
+                return true;
+            },
+            [this] () { this->cleanup(); });
+    }
+
+    void untrack()
+    {
+        if (this->_residency == nullptr) return;
+
+        this->_residency->remove(this->_residencyHandle);
+        this->_residency = nullptr;
     }
 
     void cleanup()
@@ -39,12 +78,13 @@ public:
         if (this->_textureId != 0)
         {
             glEnable(GL_TEXTURE_2D);
-            glDeleteTextures(1, &this->_textureId);
+            GLState::current().deleteTexture(this->_textureId);
             this->_textureId = 0;
         }
     }
     
     void setSize(int w, int h) { this->_width = w; this->_height = h; }
+    GLuint id() const { return this->_textureId; }
     int width() const { return this->_width; }
     int height() const { return this->_height; }
 };
@@ -0,0 +1,125 @@
+#ifndef GL_UTILITIES_THREADPOOL_H
+#define GL_UTILITIES_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads. The CPU side work of this library (decoding, mipmaps, animation,
+// culling) is spread over a pool like this, none of the tasks may call GL.
+class ThreadPool
+{
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stopping;
+
+    void work()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->_mutex);
+                this->_wake.wait(lock, [this] { return this->_stopping || !this->_tasks.empty(); });
+                if (this->_tasks.empty()) return;
+
+                task = std::move(this->_tasks.front());
+                this->_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    // Zero threads runs every task on the thread that enqueues it
+    ThreadPool(size_t threadCount = std::thread::hardware_concurrency())
+        : _stopping(false)
+    {
+        for (size_t i = 0; i < threadCount; i++) this->_workers.emplace_back([this] { this->work(); });
+    }
+
+    virtual ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_stopping = true;
+        }
+        this->_wake.notify_all();
+        for (auto& worker : this->_workers) worker.join();
+    }
+
+    size_t size() const { return this->_workers.size(); }
+
+    void enqueue(std::function<void()> task)
+    {
+        if (this->_workers.empty())
+        {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_tasks.push_back(std::move(task));
+        }
+        this->_wake.notify_one();
+    }
+
+    // Calls function(begin, end) on ranges of at most grain items covering [0, count) and returns when
+    // all ranges are done. The calling thread helps out.
+    template <class Function>
+    void parallelFor(size_t count, size_t grain, Function function)
+    {
+        if (grain == 0) grain = 1;
+        auto rangeCount = (count + grain - 1) / grain;
+        if (rangeCount <= 1 || this->_workers.empty())
+        {
+            if (count > 0) function(size_t(0), count);
+            return;
+        }
+
+        // Helpers that start after the last range is done only touch the shared state, which outlives
+        // this call. The function is only called while this call is still waiting.
+        struct State
+        {
+            std::atomic<size_t> next;
+            std::atomic<size_t> done;
+            std::mutex mutex;
+            std::condition_variable signal;
+        };
+        auto state = std::make_shared<State>();
+        state->next = 0;
+        state->done = 0;
+
+        auto target = &function;
+        auto run = [state, target, rangeCount, grain, count] ()
+        {
+            for (auto range = state->next++; range < rangeCount; range = state->next++)
+            {
+                auto begin = range * grain;
+                (*target)(begin, begin + grain < count ? begin + grain : count);
+                if (++state->done == rangeCount)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->signal.notify_all();
+                }
+            }
+        };
+
+        auto helpers = rangeCount - 1 < this->_workers.size() ? rangeCount - 1 : this->_workers.size();
+        for (size_t i = 0; i < helpers; i++) this->enqueue(run);
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->signal.wait(lock, [&] { return state->done == rangeCount; });
+    }
+};
+
+#endif // GL_UTILITIES_THREADPOOL_H
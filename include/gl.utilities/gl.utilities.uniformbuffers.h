@@ -0,0 +1,283 @@
+#ifndef GL_UTILITIES_UNIFORMBUFFERS_H
+#define GL_UTILITIES_UNIFORMBUFFERS_H
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.state.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+// Binding points used by the uniform buffers in this library, SkinnedShader uses 0 for its bones
+enum UniformBindings
+{
+    BonesUniformBinding = 0,
+    CameraUniformBinding = 1,
+    DrawUniformBinding = 2,
+};
+
+// Column major 4x4 matrix product, result = a * b
+inline void multiplyMatrices(const float a[], const float b[], float result[])
+{
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            result[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1]
+                    + a[8 + row] * b[column * 4 + 2] + a[12 + row] * b[column * 4 + 3];
+        }
+    }
+}
+
+// Matches this block in the shaders:
+//   layout(std140) uniform Camera { mat4 u_projection; mat4 u_view; mat4 u_projectionView; vec4 u_cameraPosition; };
+struct CameraBlock
+{
+    float projection[16];
+    float view[16];
+    float projectionView[16];
+    float position[4];
+};
+
+// Matches this block in the shaders, a PVMShader with both blocks reads its model matrix from here:
+//   layout(std140) uniform Draw { mat4 u_model; };
+struct DrawBlock
+{
+    float model[16];
+};
+
+// Camera matrices uploaded once per frame and shared by every program through a fixed binding point
+class CameraUniformBuffer
+{
+    GLuint _bufferId;
+    GLuint _binding;
+    CameraBlock _block;
+
+public:
+    CameraUniformBuffer() : _bufferId(0), _binding(CameraUniformBinding), _blockName("Camera") { }
+    virtual ~CameraUniformBuffer() { }
+
+    std::string _blockName;
+
+    GLuint binding() const { return this->_binding; }
+    const CameraBlock& block() const { return this->_block; }
+
+    void setup(GLuint binding = CameraUniformBinding)
+    {
+        this->_binding = binding;
+
+        glGenBuffers(1, &this->_bufferId);
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+        GLState::current().bindBufferRange(GL_UNIFORM_BUFFER, this->_binding, this->_bufferId, 0, sizeof(CameraBlock));
+    }
+
+    // Points the camera block of a CompiledShader at our binding point, once after compiling
+    template <class ShaderType>
+    bool attach(const ShaderType& shader) const
+    {
+        return shader.bindUniformBlock(this->_blockName, this->_binding);
+    }
+
+    void update(const float projection[], const float view[], const float position[] = nullptr)
+    {
+        std::memcpy(this->_block.projection, projection, sizeof(this->_block.projection));
+        std::memcpy(this->_block.view, view, sizeof(this->_block.view));
+        multiplyMatrices(projection, view, this->_block.projectionView);
+        for (int i = 0; i < 4; i++) this->_block.position[i] = position != nullptr && i < 3 ? position[i] : (i == 3 ? 1.0f : 0.0f);
+
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &this->_block);
+        GLState::current().bindBufferRange(GL_UNIFORM_BUFFER, this->_binding, this->_bufferId, 0, sizeof(CameraBlock));
+    }
+
+    void cleanup()
+    {
+        if (this->_bufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_bufferId);
+            this->_bufferId = 0;
+        }
+    }
+};
+
+// Ring of per draw uniform data. Draw data (model matrix, material parameters) is pushed linearly at
+// offsets aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT and every draw binds its own range. The buffer
+// is split in three regions used round robin and each region is fenced. With buffer storage pushes
+// go straight into persistently mapped memory, otherwise they are staged and written with one
+// glBufferSubData in flush(). Per frame: begin(), push() all draws, flush(), then draw with bind().
+// An unstaged ring writes every push right away through an unsynchronized map of its range instead,
+// and moves on to the next region by itself when the current one is full.
+class UniformRingBuffer
+{
+    static const int RegionCount = 3;
+
+    GLuint _bufferId;
+    GLsync _fences[RegionCount];
+    unsigned char* _mapped;
+    std::vector<unsigned char> _staging;
+    size_t _regionSize;
+    size_t _alignment;
+    size_t _written;
+    int _region;
+    bool _used;
+    bool _staged;
+
+public:
+    UniformRingBuffer()
+        : _bufferId(0), _mapped(nullptr), _regionSize(0), _alignment(256), _written(0), _region(0), _used(false), _staged(true)
+    {
+        for (int i = 0; i < RegionCount; i++) this->_fences[i] = 0;
+    }
+    virtual ~UniformRingBuffer() { }
+
+    size_t alignment() const { return this->_alignment; }
+    size_t regionSize() const { return this->_regionSize; }
+
+    void setup(size_t bytesPerFrame, bool staged = true)
+    {
+        this->_staged = staged;
+
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        this->_alignment = alignment > 0 ? size_t(alignment) : 256;
+        this->_regionSize = (bytesPerFrame + this->_alignment - 1) / this->_alignment * this->_alignment;
+
+        glGenBuffers(1, &this->_bufferId);
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+
+        auto size = GLsizeiptr(this->_regionSize * RegionCount);
+#if !defined(__ANDROID__) && defined(GL_MAP_PERSISTENT_BIT)
+        if (Extensions::hasBufferStorage())
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+            this->_mapped = reinterpret_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+        }
+#endif
+        if (this->_mapped == nullptr)
+        {
+            glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+            if (staged) this->_staging.resize(this->_regionSize);
+        }
+    }
+
+    // Fences the region of the previous frame and waits until the next region is no longer read
+    void begin()
+    {
+        if (this->_used)
+        {
+            this->_fences[this->_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            this->_region = (this->_region + 1) % RegionCount;
+        }
+
+        auto fence = this->_fences[this->_region];
+        if (fence != 0)
+        {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            while (result == GL_TIMEOUT_EXPIRED)
+            {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            glDeleteSync(fence);
+            this->_fences[this->_region] = 0;
+        }
+
+        this->_written = 0;
+        this->_used = true;
+    }
+
+    // Copies size bytes into the ring, returns the buffer offset to bind or -1 when the region is full
+    GLintptr push(const void* data, size_t size)
+    {
+        if (size > this->_regionSize)
+            return -1;
+
+        if (this->_written + size > this->_regionSize)
+        {
+            if (this->_staged) return -1;
+            this->begin();
+        }
+
+        auto offset = GLintptr(this->_region * this->_regionSize + this->_written);
+        if (this->_mapped != nullptr)
+        {
+            std::memcpy(this->_mapped + offset, data, size);
+        }
+        else if (this->_staged)
+        {
+            std::memcpy(&this->_staging[this->_written], data, size);
+        }
+        else
+        {
+            // The region is fenced, so there is no need for the driver to synchronize
+            GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+            auto target = glMapBufferRange(GL_UNIFORM_BUFFER, offset, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (target == nullptr) return -1;
+            std::memcpy(target, data, size);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        this->_used = true;
+        this->_written += (size + this->_alignment - 1) / this->_alignment * this->_alignment;
+
+        return offset;
+    }
+
+    // Reserves size bytes in persistently mapped memory to be filled in later (before the draw that uses
+    // them is submitted). Returns -1 when the ring is not persistently mapped.
+    GLintptr reserve(size_t size, void*& target)
+    {
+        target = nullptr;
+        if (this->_mapped == nullptr || size > this->_regionSize)
+            return -1;
+
+        if (this->_written + size > this->_regionSize)
+        {
+            if (this->_staged) return -1;
+            this->begin();
+        }
+
+        auto offset = GLintptr(this->_region * this->_regionSize + this->_written);
+        target = this->_mapped + offset;
+        this->_used = true;
+        this->_written += (size + this->_alignment - 1) / this->_alignment * this->_alignment;
+
+        return offset;
+    }
+
+    // Makes everything pushed since begin() visible to the gpu, call this before the first draw
+    void flush()
+    {
+        if (this->_mapped != nullptr || !this->_staged || this->_written == 0) return;
+
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+        glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(this->_region * this->_regionSize), GLsizeiptr(this->_written), this->_staging.data());
+    }
+
+    void bind(GLintptr offset, size_t size, GLuint binding = DrawUniformBinding) const
+    {
+        GLState::current().bindBufferRange(GL_UNIFORM_BUFFER, binding, this->_bufferId, offset, GLsizeiptr(size));
+    }
+
+    void cleanup()
+    {
+        for (int i = 0; i < RegionCount; i++)
+        {
+            if (this->_fences[i] != 0) glDeleteSync(this->_fences[i]);
+            this->_fences[i] = 0;
+        }
+        if (this->_mapped != nullptr)
+        {
+            GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->_bufferId);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            this->_mapped = nullptr;
+        }
+        if (this->_bufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_bufferId);
+            this->_bufferId = 0;
+        }
+    }
+};
+
+#endif // GL_UTILITIES_UNIFORMBUFFERS_H
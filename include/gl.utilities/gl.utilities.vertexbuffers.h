@@ -12,10 +12,19 @@
 
 #include <string>
 #include <vector>
-#include <map>
 #include <iostream>
-
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+#include "gl.utilities.extensions.h"
+#include "gl.utilities.meshoptimizer.h"
+#include "gl.utilities.residency.h"
 #include "gl.utilities.shaders.h"
+#include "gl.utilities.simplifier.h"
+#include "gl.utilities.state.h"
+#include "gl.utilities.vertexpacking.h"
 
 // Vertex
 template <class...> class Vertex;
@@ -58,6 +67,56 @@ public:
     BoneType bone;
 };
 
+// Vertex welding, identical vertices are found by hashing and comparing their raw bytes.
+// This assumes the vertex types have no padding, which holds for the float based types.
+template <class VertexType>
+size_t hashVertex(const VertexType& vertex)
+{
+    auto bytes = reinterpret_cast<const unsigned char*>(&vertex);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(VertexType); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return size_t(hash ^ (hash >> 32));
+}
+
+template <class VertexType>
+void weldVertices(const VertexType* verts, size_t count, std::vector<VertexType>& unique, std::vector<unsigned int>& indices)
+{
+    const unsigned int empty = ~0u;
+
+    size_t slotCount = 16;
+    while (slotCount < count * 2) slotCount <<= 1;
+    std::vector<unsigned int> slots(slotCount, empty);
+
+    unique.clear();
+    unique.reserve(count);
+    indices.resize(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto slot = hashVertex(verts[i]) & (slotCount - 1);
+        while (slots[slot] != empty && std::memcmp(&unique[slots[slot]], &verts[i], sizeof(VertexType)) != 0)
+        {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+
+        if (slots[slot] == empty)
+        {
+            slots[slot] = static_cast<unsigned int>(unique.size());
+            unique.push_back(verts[i]);
+        }
+        indices[i] = slots[slot];
+    }
+}
+
+template <class VertexType>
+void weldVertices(const std::vector<VertexType>& verts, std::vector<VertexType>& unique, std::vector<unsigned int>& indices)
+{
+    weldVertices(verts.data(), verts.size(), unique, indices);
+}
 
 // Vertex buffers
 class RenderableBuffer
@@ -66,9 +125,41 @@ protected:
 public:
     unsigned int _vertexArrayId;
     unsigned int _vertexBufferId;
+    unsigned int _indexBufferId;
+    unsigned int _indirectBufferId;
+    unsigned int _instanceBufferId;
+    int _instanceCapacity;
+    int _instanceCount;
+    int _firstVertex;
     int _vertexCount;
+    int _indexCount;
+    GLenum _indexType;
     GLenum _drawMode;
-    std::map<int, int> _faces;
+    bool _indexed;
+    bool _facesDirty;
+    bool _optimized;
+    MeshOptimizerStats _optimizerStats;
+    int _lodLevels;
+    float _lodRatio;
+    ThreadPool* _lodPool;
+    float _lodTolerance;
+    float _projectedSize;
+    bool _bounded;
+    float _boundsMin[3];
+    float _boundsMax[3];
+    float _center[3];
+    float _radius;
+    std::vector<GLsizei> _lodCounts;
+    std::vector<const GLvoid*> _lodOffsets;
+    std::vector<float> _lodErrors;
+    ResidencyManager* _residency;
+    ResidencyManager::Handle _residencyHandle;
+    std::function<void()> _instanceSetup;
+
+    // Faces as flat arrays so they can be submitted with a single multi draw call
+    std::vector<GLint> _faceFirsts;
+    std::vector<GLsizei> _faceCounts;
+    std::vector<const GLvoid*> _faceOffsets;
 
     bool setupRenderableBuffer(int vertexCount)
     {
@@ -80,86 +171,674 @@ public:
         return true;
     }
 
-    RenderableBuffer() : _vertexArrayId(0), _vertexBufferId(0), _vertexCount(0), _drawMode(GL_TRIANGLES) { }
-    virtual ~RenderableBuffer() { }
+    // Reorders welded triangles for the vertex cache, overdraw and vertex fetch. Faces are optimized
+    // one by one and keep their ranges, overlapping faces are left alone.
+    template <class VertexType>
+    void optimizeIndices(std::vector<VertexType>& unique, std::vector<unsigned int>& indices)
+    {
+        if (!this->_optimized || this->_drawMode != GL_TRIANGLES) return;
+
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t i = 0; i < this->_faceFirsts.size(); i++)
+        {
+            if (this->_faceFirsts[i] < 0 || this->_faceCounts[i] % 3 != 0 || size_t(this->_faceFirsts[i] + this->_faceCounts[i]) > indices.size()) return;
+            ranges.push_back(std::make_pair(size_t(this->_faceFirsts[i]), size_t(this->_faceCounts[i])));
+        }
+        std::sort(ranges.begin(), ranges.end());
+        for (size_t i = 1; i < ranges.size(); i++)
+        {
+            if (ranges[i].first < ranges[i - 1].first + ranges[i - 1].second) return;
+        }
+
+        MeshOptimizer optimizer;
+        this->_optimizerStats = optimizer.optimize(unique, indices, ranges);
+    }
+
+    // Appends the simplified levels to the welded indices, the first _lodCounts[0] indices stay the
+    // full mesh. Only buffers drawn as one list of triangles get levels.
+    template <class VertexType>
+    void buildLods(const std::vector<VertexType>& unique, std::vector<unsigned int>& indices)
+    {
+        this->_lodCounts.clear();
+        this->_lodOffsets.clear();
+        this->_lodErrors.clear();
+        if (this->_lodLevels <= 1 || this->_drawMode != GL_TRIANGLES || !this->_faceFirsts.empty()) return;
+
+        // A trailing partial triangle is never drawn, and the levels are built from whole triangles
+        indices.resize(indices.size() / 3 * 3);
+
+        MeshSimplifier simplifier;
+        if (!simplifier.prepare(unique, indices)) return;
+
+        std::vector<MeshSimplifier::Level> levels;
+        simplifier.buildLods(indices, this->_lodLevels, this->_lodRatio, levels, this->_lodPool);
+
+        MeshOptimizer optimizer;
+        auto indexSize = unique.size() <= 0xFFFF ? sizeof(unsigned short) : sizeof(unsigned int);
+        this->_lodCounts.push_back(GLsizei(indices.size()));
+        this->_lodOffsets.push_back(nullptr);
+        this->_lodErrors.push_back(0.0f);
+        for (auto& level : levels)
+        {
+            if (level.indices.empty() || level.indices.size() >= size_t(this->_lodCounts.back())) break;
+            if (this->_optimized) optimizer.reorderTriangles(level.indices.data(), level.indices.size(), unique.size());
+
+            this->_lodOffsets.push_back(reinterpret_cast<const GLvoid*>(indices.size() * indexSize));
+            this->_lodCounts.push_back(GLsizei(level.indices.size()));
+            this->_lodErrors.push_back(level.error);
+            indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+        }
+    }
+
+    // The box and sphere around the positions, used for culling and picking levels of detail. Vertex
+    // types without float positions stay unbounded.
+    template <class VertexType>
+    void computeBounds(const VertexType* verts, size_t count)
+    {
+        this->_bounded = count > 0 && VertexPosition<VertexType>::get(verts[0]) != nullptr;
+        if (!this->_bounded) return;
+
+        auto first = VertexPosition<VertexType>::get(verts[0]);
+        std::copy(first, first + 3, this->_boundsMin);
+        std::copy(first, first + 3, this->_boundsMax);
+        for (size_t i = 1; i < count; i++)
+        {
+            auto p = VertexPosition<VertexType>::get(verts[i]);
+            for (int c = 0; c < 3; c++)
+            {
+                this->_boundsMin[c] = std::min(this->_boundsMin[c], p[c]);
+                this->_boundsMax[c] = std::max(this->_boundsMax[c], p[c]);
+            }
+        }
+
+        float radius = 0.0f;
+        for (int c = 0; c < 3; c++) this->_center[c] = (this->_boundsMin[c] + this->_boundsMax[c]) * 0.5f;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto p = VertexPosition<VertexType>::get(verts[i]);
+            auto dx = p[0] - this->_center[0], dy = p[1] - this->_center[1], dz = p[2] - this->_center[2];
+            radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+        }
+        this->_radius = std::sqrt(radius);
+    }
+
+    // Uploads the vertices to the bound GL_ARRAY_BUFFER. When indexed, identical vertices are welded
+    // and an element buffer is attached to the bound vertex array. The index at position i belongs to
+    // vertex i as it was added, so faces keep addressing the same ranges.
+    template <class VertexType>
+    void uploadVertices(const VertexType* verts, size_t count)
+    {
+        this->computeBounds(verts, count);
+        if (!this->_indexed || count == 0)
+        {
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(count * sizeof(VertexType)), verts, GL_STATIC_DRAW);
+            this->setupFaces();
+            return;
+        }
+
+        std::vector<VertexType> unique;
+        std::vector<unsigned int> indices;
+        weldVertices(verts, count, unique, indices);
+        this->optimizeIndices(unique, indices);
+        this->buildLods(unique, indices);
+
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(unique.size() * sizeof(VertexType)), unique.data(), GL_STATIC_DRAW);
+        this->_vertexCount = int(unique.size());
+
+        this->uploadIndices(indices, unique.size());
+        this->setupFaces();
+    }
+
+    template <class VertexType>
+    void uploadVertices(const std::vector<VertexType>& verts)
+    {
+        this->uploadVertices(verts.data(), verts.size());
+    }
+
+    // Same as uploadVertices, but the (welded) vertices are converted from the source layout into the
+    // packed layout before they are uploaded
+    template <class SourceLayout, class PackedLayout, class VertexType>
+    void uploadPackedVertices(const std::vector<VertexType>& verts)
+    {
+        this->computeBounds(verts.data(), verts.size());
+
+        std::vector<VertexType> unique;
+        std::vector<unsigned int> indices;
+        auto source = &verts;
+        if (this->_indexed && !verts.empty())
+        {
+            weldVertices(verts, unique, indices);
+            this->optimizeIndices(unique, indices);
+            this->buildLods(unique, indices);
+            source = &unique;
+        }
+
+        std::vector<unsigned char> packed(source->size() * PackedLayout::stride);
+        VertexPacker<SourceLayout, PackedLayout>::pack(source->data(), packed.data(), source->size());
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(packed.size()), packed.data(), GL_STATIC_DRAW);
+
+        if (source == &unique)
+        {
+            this->_vertexCount = int(unique.size());
+            this->uploadIndices(indices, unique.size());
+        }
+        this->setupFaces();
+    }
+
+    template <class SourceLayout, class PackedLayout, class VertexType, class ShaderType>
+    bool setupPackedBuffer(std::vector<VertexType>& verts, const ShaderType& shader)
+    {
+        static_assert(sizeof(VertexType) == SourceLayout::stride, "Vertex type does not match the source layout");
+
+        if (!this->setupRenderableBuffer(int(verts.size())))
+            return false;
+
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+
+        this->template uploadPackedVertices<SourceLayout, PackedLayout>(verts);
+
+        shader.template setupAttributes<PackedLayout>();
+
+        GLState::current().bindVertexArray(0);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return true;
+    }
+
+    void uploadIndices(const std::vector<unsigned int>& indices, size_t vertexCount)
+    {
+        glGenBuffers(1, &this->_indexBufferId);
+        GLState::current().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->_indexBufferId);
+
+        if (vertexCount <= 0xFFFF)
+        {
+            std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(shortIndices.size() * sizeof(unsigned short)), shortIndices.data(), GL_STATIC_DRAW);
+            this->_indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indices.size() * sizeof(unsigned int)), indices.data(), GL_STATIC_DRAW);
+            this->_indexType = GL_UNSIGNED_INT;
+        }
+        this->_indexCount = this->_lodCounts.empty() ? int(indices.size()) : int(this->_lodCounts[0]);
+    }
+
+    // Sorts the faces on their first vertex and merges faces that continue where the previous one
+    // stopped. Faces with the same first vertex are dropped, the first one added wins. Only faces
+    // drawn as independent points, lines or triangles can be merged, and only after a face that ends
+    // on a whole primitive.
+    void compactFaces()
+    {
+        GLsizei primitiveSize = this->_drawMode == GL_POINTS ? 1 : (this->_drawMode == GL_LINES ? 2 : (this->_drawMode == GL_TRIANGLES ? 3 : 0));
+
+        std::vector<size_t> order(this->_faceFirsts.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this] (size_t a, size_t b) { return this->_faceFirsts[a] < this->_faceFirsts[b]; });
+
+        std::vector<GLint> firsts;
+        std::vector<GLsizei> counts;
+        firsts.reserve(order.size());
+        counts.reserve(order.size());
+        for (auto i : order)
+        {
+            auto first = this->_faceFirsts[i];
+            auto count = this->_faceCounts[i];
+            if (!firsts.empty() && firsts.back() == first) continue;
+            if (primitiveSize > 0 && !firsts.empty() && firsts.back() + counts.back() == first && counts.back() % primitiveSize == 0)
+            {
+                counts.back() += count;
+                continue;
+            }
+            firsts.push_back(first);
+            counts.push_back(count);
+        }
+
+        this->_faceFirsts.swap(firsts);
+        this->_faceCounts.swap(counts);
+    }
+
+    // Compacts the faces and prepares the element offsets or the indirect command buffer for render()
+    void setupFaces()
+    {
+        this->_facesDirty = false;
+        if (this->_indirectBufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_indirectBufferId);
+            this->_indirectBufferId = 0;
+        }
+        if (this->_faceFirsts.empty()) return;
+
+        this->compactFaces();
+
+        this->_faceOffsets.resize(this->_faceFirsts.size());
+        for (size_t i = 0; i < this->_faceFirsts.size(); i++)
+        {
+            this->_faceOffsets[i] = reinterpret_cast<const GLvoid*>(size_t(this->_faceFirsts[i] * this->indexSize()));
+        }
+
+#if !defined(__ANDROID__) && defined(GL_DRAW_INDIRECT_BUFFER)
+        if (this->_faceFirsts.size() > 1 && Extensions::hasMultiDrawIndirect())
+        {
+            std::vector<GLuint> commands;
+            for (size_t i = 0; i < this->_faceFirsts.size(); i++)
+            {
+                if (this->_indexType != 0)
+                {
+                    // count, instanceCount, firstIndex, baseVertex, baseInstance
+                    GLuint command[] = { GLuint(this->_faceCounts[i]), 1, GLuint(this->_faceFirsts[i]), 0, 0 };
+                    commands.insert(commands.end(), command, command + 5);
+                }
+                else
+                {
+                    // count, instanceCount, first, baseInstance
+                    GLuint command[] = { GLuint(this->_faceCounts[i]), 1, GLuint(this->_faceFirsts[i]), 0 };
+                    commands.insert(commands.end(), command, command + 4);
+                }
+            }
+
+            glGenBuffers(1, &this->_indirectBufferId);
+            GLState::current().bindBuffer(GL_DRAW_INDIRECT_BUFFER, this->_indirectBufferId);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(commands.size() * sizeof(GLuint)), commands.data(), GL_STATIC_DRAW);
+            GLState::current().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+#endif
+    }
+
+    RenderableBuffer()
+        : _vertexArrayId(0), _vertexBufferId(0), _indexBufferId(0), _indirectBufferId(0), _instanceBufferId(0), _instanceCapacity(0), _instanceCount(0), _firstVertex(0), _vertexCount(0), _indexCount(0),
+          _indexType(0), _drawMode(GL_TRIANGLES), _indexed(false), _facesDirty(false), _optimized(false), _optimizerStats(),
+          _lodLevels(1), _lodRatio(0.5f), _lodPool(nullptr), _lodTolerance(1.0f), _projectedSize(std::numeric_limits<float>::infinity()), _bounded(false), _boundsMin(), _boundsMax(), _center(), _radius(0.0f), _residency(nullptr), _residencyHandle(0)
+    { }
+    virtual ~RenderableBuffer() { this->untrack(); }
 
     void setDrawMode(GLenum mode) { this->_drawMode = mode; }
-    void addFace(int start, int count) { this->_faces.insert(std::make_pair(start, count)); }
+    void setIndexed(bool indexed) { this->_indexed = indexed; }
+    // Optimizes the triangle order of indexed triangle buffers on setup, see MeshOptimizer
+    void setOptimized(bool optimized) { this->_optimized = optimized; }
+    const MeshOptimizerStats& optimizerStats() const { return this->_optimizerStats; }
+
+    // Generates levels of detail for indexed triangle buffers without faces on setup, each level has
+    // ratio times the triangles of the one before. Large meshes are simplified with the pool's help.
+    void setLods(int levels, float ratio = 0.5f, ThreadPool* pool = nullptr) { this->_lodLevels = levels; this->_lodRatio = ratio; this->_lodPool = pool; }
+    int lodCount() const { return this->_lodCounts.empty() ? 1 : int(this->_lodCounts.size()); }
+
+    // The radius of the mesh on screen in pixels, render() draws the coarsest level whose error stays
+    // within the tolerance in pixels
+    void setProjectedSize(float pixels) { this->_projectedSize = pixels; }
+    void setLodTolerance(float pixels) { this->_lodTolerance = pixels; }
+
+    int lodLevel() const
+    {
+        int level = 0;
+        for (size_t i = 1; i < this->_lodErrors.size(); i++)
+        {
+            if (this->_lodErrors[i] * this->_projectedSize <= this->_lodTolerance) level = int(i);
+        }
+        return level;
+    }
+
+    // Object space bounds of the positions from the last setup, see FrustumCuller
+    bool hasBounds() const { return this->_bounded; }
+    const float* boundsMin() const { return this->_boundsMin; }
+    const float* boundsMax() const { return this->_boundsMax; }
+    const float* center() const { return this->_center; }
+    float radius() const { return this->_radius; }
+
+    // Estimates the radius in pixels of the mesh drawn with these column major matrices
+    float projectedRadius(const float projection[], const float view[], const float model[], float viewportHeight) const
+    {
+        float world[3], scale = 0.0f;
+        for (int r = 0; r < 3; r++) world[r] = model[r] * this->_center[0] + model[4 + r] * this->_center[1] + model[8 + r] * this->_center[2] + model[12 + r];
+        for (int c = 0; c < 3; c++) scale = std::max(scale, model[c * 4] * model[c * 4] + model[c * 4 + 1] * model[c * 4 + 1] + model[c * 4 + 2] * model[c * 4 + 2]);
+        auto radius = this->_radius * std::sqrt(scale);
+
+        // Orthographic projections do not shrink with the distance
+        if (projection[11] == 0.0f) return radius * projection[5] * viewportHeight * 0.5f;
+
+        auto distance = -(view[2] * world[0] + view[6] * world[1] + view[10] * world[2] + view[14]);
+        if (distance <= radius) return std::numeric_limits<float>::infinity();
+
+        return radius * projection[5] * viewportHeight * 0.5f / distance;
+    }
+    void addFace(int start, int count) { this->_faceFirsts.push_back(start); this->_faceCounts.push_back(count); this->_facesDirty = true; }
+    int faceCount() const { return int(this->_faceFirsts.size()); }
     int vertexCount() const { return this->_vertexCount; }
+    int indexCount() const { return this->_indexCount; }
+    int instanceCount() const { return this->_instanceCount; }
+
+    // Size of all GL buffers owned by this buffer as reported by the driver
+    size_t gpuBytes() const
+    {
+        size_t bytes = 0;
+        for (auto buffer : { this->_vertexBufferId, this->_indexBufferId, this->_indirectBufferId, this->_instanceBufferId })
+        {
+            if (buffer == 0) continue;
+
+            GLint size = 0;
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, buffer);
+            glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+            bytes += size_t(size);
+        }
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
 
+        return bytes;
+    }
+
+    // Lets the manager evict the uploaded buffers, reload is called on the next render and should
+    // upload the vertices again, for example by refilling verts() and calling setup()
+    void track(ResidencyManager& manager, std::function<bool(RenderableBuffer&)> reload)
+    {
+        this->untrack();
+        this->_residency = &manager;
+        this->_residencyHandle = manager.add(
+            this->gpuBytes(),
+            [this, reload] ()
+            {
+                if (!reload(*this)) return false;
+                if (this->_instanceSetup) this->_instanceSetup();
+                this->_residency->resize(this->_residencyHandle, this->gpuBytes());
+                return true;
+            },
+            [this] () { this->cleanup(); });
+    }
+
+    void untrack()
+    {
+        if (this->_residency == nullptr) return;
+
+        this->_residency->remove(this->_residencyHandle);
+        this->_residency = nullptr;
+    }
+
+    // Adds a per instance stream to the vertex array, call this after setup(). Both shaders bind their
+    // vertex attributes to the same locations before linking, so the vertex array fits either program.
+    // A tracked buffer sets the stream up again after it was evicted, with no instances until the next
+    // updateInstances().
+    template <class InstanceType>
+    bool setupInstances(const InstancedShader& shader, int maxInstanceCount)
+    {
+        auto instancedShader = &shader;
+        this->_instanceSetup = [this, instancedShader, maxInstanceCount] () { this->createInstances<InstanceType>(*instancedShader, maxInstanceCount); };
+
+        return this->createInstances<InstanceType>(shader, maxInstanceCount);
+    }
+
+    template <class InstanceType>
+    bool createInstances(const InstancedShader& shader, int maxInstanceCount)
+    {
+        if (this->_vertexArrayId == 0)
+            return false;
+
+        if (this->_instanceBufferId == 0) glGenBuffers(1, &this->_instanceBufferId);
+        this->_instanceCapacity = maxInstanceCount;
+        this->_instanceCount = 0;
+
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_instanceBufferId);
+
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(maxInstanceCount * sizeof(InstanceType)), nullptr, GL_STREAM_DRAW);
+        shader.setupInstanceAttributes<InstanceType>();
+
+        GLState::current().bindVertexArray(0);
+
+        return true;
+    }
+
+    // Replaces the instance data, the buffer is orphaned first so the gpu can keep reading the old data
+    template <class InstanceType>
+    void updateInstances(const InstanceType* instances, int count)
+    {
+        this->_instanceCount = count < this->_instanceCapacity ? count : this->_instanceCapacity;
+
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_instanceBufferId);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(this->_instanceCapacity * sizeof(InstanceType)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(this->_instanceCount * sizeof(InstanceType)), instances);
+    }
+
+    // Draws count instances, or all instances from the last updateInstances() when count is negative
+    void renderInstanced(int count = -1)
+    {
+        if (count < 0) count = this->_instanceCount;
+        if (count <= 0) return;
+
+        if (this->_residency != nullptr && !this->_residency->touch(this->_residencyHandle)) return;
+        if (this->_facesDirty) this->setupFaces();
+
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        if (this->_faceFirsts.empty())
+        {
+            auto level = size_t(this->lodLevel());
+            if (level > 0) glDrawElementsInstanced(this->_drawMode, this->_lodCounts[level], this->_indexType, this->_lodOffsets[level], count);
+            else if (this->_indexType != 0) glDrawElementsInstanced(this->_drawMode, this->_indexCount, this->_indexType, 0, count);
+            else glDrawArraysInstanced(this->_drawMode, this->_firstVertex, this->_vertexCount, count);
+        }
+        else if (this->_indexType != 0)
+        {
+            for (size_t i = 0; i < this->_faceCounts.size(); i++) glDrawElementsInstanced(this->_drawMode, this->_faceCounts[i], this->_indexType, this->_faceOffsets[i], count);
+        }
+        else
+        {
+            for (size_t i = 0; i < this->_faceCounts.size(); i++) glDrawArraysInstanced(this->_drawMode, this->_faceFirsts[i], this->_faceCounts[i], count);
+        }
+    }
+    int indexSize() const { return this->_indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int); }
+
+    // Leaves the vertex array bound, the next render() of the same buffer does not rebind it
     void render()
     {
-        glBindVertexArray(this->_vertexArrayId);
-        if (this->_faces.empty())
+        if (this->_residency != nullptr && !this->_residency->touch(this->_residencyHandle)) return;
+        if (this->_facesDirty) this->setupFaces();
+
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        if (this->_faceFirsts.empty())
         {
-            glDrawArrays(this->_drawMode, 0, this->_vertexCount);
+            auto level = size_t(this->lodLevel());
+            if (level > 0) glDrawElements(this->_drawMode, this->_lodCounts[level], this->_indexType, this->_lodOffsets[level]);
+            else if (this->_indexType != 0) glDrawElements(this->_drawMode, this->_indexCount, this->_indexType, 0);
+            else glDrawArrays(this->_drawMode, this->_firstVertex, this->_vertexCount);
+        }
+#ifdef __ANDROID__
+        else if (this->_indexType != 0)
+        {
+            for (size_t i = 0; i < this->_faceCounts.size(); i++) glDrawElements(this->_drawMode, this->_faceCounts[i], this->_indexType, this->_faceOffsets[i]);
+        }
+        else
+        {
+            for (size_t i = 0; i < this->_faceCounts.size(); i++) glDrawArrays(this->_drawMode, this->_faceFirsts[i], this->_faceCounts[i]);
+        }
+#else
+#ifdef GL_DRAW_INDIRECT_BUFFER
+        else if (this->_indirectBufferId != 0)
+        {
+            GLState::current().bindBuffer(GL_DRAW_INDIRECT_BUFFER, this->_indirectBufferId);
+            if (this->_indexType != 0) glMultiDrawElementsIndirect(this->_drawMode, this->_indexType, 0, GLsizei(this->_faceCounts.size()), 0);
+            else glMultiDrawArraysIndirect(this->_drawMode, 0, GLsizei(this->_faceCounts.size()), 0);
+        }
+#endif
+        else if (this->_indexType != 0)
+        {
+            glMultiDrawElements(this->_drawMode, this->_faceCounts.data(), this->_indexType, this->_faceOffsets.data(), GLsizei(this->_faceCounts.size()));
         }
         else
         {
-            for (auto pair : this->_faces) glDrawArrays(this->_drawMode, pair.first, pair.second);
+            glMultiDrawArrays(this->_drawMode, this->_faceFirsts.data(), this->_faceCounts.data(), GLsizei(this->_faceCounts.size()));
         }
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif // __ANDROID__
     }
 
-    void cleanup()
+    virtual void cleanup()
     {
         if (this->_vertexBufferId != 0)
         {
-            glDeleteBuffers(1, &this->_vertexBufferId);
+            GLState::current().deleteBuffer(this->_vertexBufferId);
             this->_vertexBufferId = 0;
         }
+        if (this->_indexBufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_indexBufferId);
+            this->_indexBufferId = 0;
+            this->_indexType = 0;
+            this->_indexCount = 0;
+        }
+        if (this->_indirectBufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_indirectBufferId);
+            this->_indirectBufferId = 0;
+        }
+        if (this->_instanceBufferId != 0)
+        {
+            GLState::current().deleteBuffer(this->_instanceBufferId);
+            this->_instanceBufferId = 0;
+            this->_instanceCapacity = this->_instanceCount = 0;
+        }
         if (this->_vertexArrayId != 0)
         {
-            glDeleteVertexArrays(1, &this->_vertexArrayId);
+            GLState::current().deleteVertexArray(this->_vertexArrayId);
             this->_vertexArrayId = 0;
         }
+        this->_lodCounts.clear();
+        this->_lodOffsets.clear();
+        this->_lodErrors.clear();
+        this->_bounded = false;
+        std::fill(this->_boundsMin, this->_boundsMin + 3, 0.0f);
+        std::fill(this->_boundsMax, this->_boundsMax + 3, 0.0f);
+        std::fill(this->_center, this->_center + 3, 0.0f);
+        this->_radius = 0.0f;
     }
 };
 
-template <class...> class VertexBuffer;
+// What setup() does with the built vertices once they are uploaded
+enum class VertexRelease
+{
+    Clear,  // keep the capacity for the next build
+    Shrink, // give the memory back
+    Keep,   // keep the vertices, so setup() can upload them again
+};
 
-template <class PositionType, class ColorType>
-class VertexBuffer<PositionType, ColorType> : public RenderableBuffer
+// Vertex storage shared by the vertex buffers. Besides adding vertices one by one they can be added
+// in bulk, moved in as a prebuilt vector, written in place through allocate(), or uploaded straight
+// from memory owned by the caller with setup(verts, count) without copying them in at all.
+template <class VertexType, class ShaderType>
+class VertexBuilder : public RenderableBuffer
 {
-    const Shader<PositionType, ColorType>& _shader;
-    std::vector<Vertex<PositionType, ColorType>> _verts;
-    ColorType _nextColor;
+public:
+    const ShaderType& _shader;
+    std::vector<VertexType> _verts;
+    VertexRelease _release;
+
+protected:
+    void releaseVertices()
+    {
+        if (this->_release == VertexRelease::Clear) this->_verts.clear();
+        else if (this->_release == VertexRelease::Shrink) std::vector<VertexType>().swap(this->_verts);
+    }
+
+    template <class SourceLayout, class PackedLayout>
+    bool setupPackedVertices()
+    {
+        if (this->_vertexArrayId != 0) this->cleanup();
+        if (!this->template setupPackedBuffer<SourceLayout, PackedLayout>(this->_verts, this->_shader))
+            return false;
+
+        this->releaseVertices();
+        return true;
+    }
 
 public:
-    VertexBuffer(const Shader<PositionType, ColorType>& shader) : _shader(shader) { }
-    virtual ~VertexBuffer() { }
+    VertexBuilder(const ShaderType& shader) : _shader(shader), _release(VertexRelease::Clear) { }
+    virtual ~VertexBuilder() { }
 
-    std::vector<Vertex<PositionType, ColorType>>& verts() { return this->_verts; }
+    std::vector<VertexType>& verts() { return this->_verts; }
+    const std::vector<VertexType>& verts() const { return this->_verts; }
 
-    VertexBuffer<PositionType, ColorType>& operator << (const Vertex<PositionType, ColorType>& vertex)
+    void setRelease(VertexRelease release) { this->_release = release; }
+
+    void reserve(size_t count) { this->_verts.reserve(count); }
+
+    void append(const VertexType* verts, size_t count)
     {
-        this->_verts.push_back(vertex);
-        this->_vertexCount = this->_verts.size();
+        this->_verts.insert(this->_verts.end(), verts, verts + count);
+        this->_vertexCount = int(this->_verts.size());
+    }
 
-        return *this;
+    void append(const std::vector<VertexType>& verts) { this->append(verts.data(), verts.size()); }
+
+    // Takes over a prebuilt vector without copying it
+    void assign(std::vector<VertexType>&& verts)
+    {
+        this->_verts = std::move(verts);
+        this->_vertexCount = int(this->_verts.size());
     }
 
+    // Grows the vertices by count and returns the first new one to write into
+    VertexType* allocate(size_t count)
+    {
+        auto first = this->_verts.size();
+        this->_verts.resize(first + count);
+        this->_vertexCount = int(this->_verts.size());
+
+        return this->_verts.data() + first;
+    }
+
+    // Uploads the built vertices, setting up again replaces the previous GL buffers
     bool setup()
     {
-        if (!this->setupRenderableBuffer(this->_verts.size()))
+        if (!this->setup(this->_verts.data(), this->_verts.size()))
+            return false;
+
+        this->releaseVertices();
+        return true;
+    }
+
+    // Uploads vertices from memory owned by the caller, for example an arena or scratch allocator
+    bool setup(const VertexType* verts, size_t count)
+    {
+        if (this->_vertexArrayId != 0) this->cleanup();
+        if (!this->setupRenderableBuffer(int(count)))
             return false;
 
-        glBindVertexArray(this->_vertexArrayId);
-        glBindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
 
-        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, ColorType>)), 0, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, ColorType>)), reinterpret_cast<const GLvoid*>(&this->_verts[0]));
+        this->uploadVertices(verts, count);
 
         this->_shader.setupAttributes();
 
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        this->_verts.clear();
+        GLState::current().bindVertexArray(0);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
 
         return true;
     }
+};
+
+template <class...> class VertexBuffer;
+
+template <class PositionType, class ColorType>
+class VertexBuffer<PositionType, ColorType> : public VertexBuilder<Vertex<PositionType, ColorType>, Shader<PositionType, ColorType>>
+{
+    ColorType _nextColor;
+
+public:
+    VertexBuffer(const Shader<PositionType, ColorType>& shader) : VertexBuilder<Vertex<PositionType, ColorType>, Shader<PositionType, ColorType>>(shader) { }
+    virtual ~VertexBuffer() { }
+
+    VertexBuffer<PositionType, ColorType>& operator << (const Vertex<PositionType, ColorType>& vertex)
+    {
+        this->_verts.push_back(vertex);
+        this->_vertexCount = this->_verts.size();
+
+        return *this;
+    }
+
+    // Uploads the vertices converted to the packed attribute types, for example
+    // setupPacked<glm::vec3, PackedNormal, HalfTexcoord>()
+    template <class... PackedTypes>
+    bool setupPacked()
+    {
+        return this->template setupPackedVertices<VertexLayout<PositionType, ColorType>, VertexLayout<PackedTypes...>>();
+    }
 
 public:
     VertexBuffer<PositionType, ColorType>& vertex(const PositionType& position)
@@ -182,19 +861,15 @@ public:
 };
 
 template <class PositionType, class NormalType, class TexcoordType>
-class VertexBuffer<PositionType, NormalType, TexcoordType> : public RenderableBuffer
+class VertexBuffer<PositionType, NormalType, TexcoordType> : public VertexBuilder<Vertex<PositionType, NormalType, TexcoordType>, Shader<PositionType, NormalType, TexcoordType>>
 {
 public:
-    const Shader<PositionType, NormalType, TexcoordType>& _shader;
-    std::vector<Vertex<PositionType, NormalType, TexcoordType>> _verts;
     NormalType _nextNormal;
     TexcoordType _nextTexcoord;
 
-    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType>& shader) : _shader(shader) { }
+    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType>& shader) : VertexBuilder<Vertex<PositionType, NormalType, TexcoordType>, Shader<PositionType, NormalType, TexcoordType>>(shader) { }
     virtual ~VertexBuffer() { }
 
-    std::vector<Vertex<PositionType, NormalType, TexcoordType>>& verts() { return this->_verts; }
-
     VertexBuffer<PositionType, NormalType, TexcoordType>& operator << (const Vertex<PositionType, NormalType, TexcoordType>& vertex)
     {
         this->_verts.push_back(vertex);
@@ -203,25 +878,12 @@ public:
         return *this;
     }
 
-    bool setup()
+    // Uploads the vertices converted to the packed attribute types, for example
+    // setupPacked<glm::vec3, PackedNormal, HalfTexcoord>()
+    template <class... PackedTypes>
+    bool setupPacked()
     {
-        if (!this->setupRenderableBuffer(this->_verts.size()))
-            return false;
-
-        glBindVertexArray(this->_vertexArrayId);
-        glBindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
-
-        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, NormalType, TexcoordType>)), 0, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, NormalType, TexcoordType>)), reinterpret_cast<const GLvoid*>(&this->_verts[0]));
-
-        this->_shader.setupAttributes();
-
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        this->_verts.clear();
-
-        return true;
+        return this->template setupPackedVertices<VertexLayout<PositionType, NormalType, TexcoordType>, VertexLayout<PackedTypes...>>();
     }
 
 public:
@@ -252,20 +914,16 @@ public:
 };
 
 template <class PositionType, class NormalType, class TexcoordType, class ColorType>
-class VertexBuffer<PositionType, NormalType, TexcoordType, ColorType> : public RenderableBuffer
+class VertexBuffer<PositionType, NormalType, TexcoordType, ColorType> : public VertexBuilder<Vertex<PositionType, NormalType, TexcoordType, ColorType>, Shader<PositionType, NormalType, TexcoordType, ColorType>>
 {
 public:
-    const Shader<PositionType, NormalType, TexcoordType, ColorType>& _shader;
-    std::vector<Vertex<PositionType, NormalType, TexcoordType, ColorType>> _verts;
     NormalType _nextNormal;
     TexcoordType _nextTexcoord;
     ColorType _nextColor;
 
-    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType, ColorType>& shader) : _shader(shader) { }
+    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType, ColorType>& shader) : VertexBuilder<Vertex<PositionType, NormalType, TexcoordType, ColorType>, Shader<PositionType, NormalType, TexcoordType, ColorType>>(shader) { }
     virtual ~VertexBuffer() { }
 
-    std::vector<Vertex<PositionType, NormalType, TexcoordType, ColorType>>& verts() { return this->_verts; }
-
     VertexBuffer<PositionType, NormalType, TexcoordType, ColorType>& operator << (const Vertex<PositionType, NormalType, TexcoordType, ColorType>& vertex)
     {
         this->_verts.push_back(vertex);
@@ -274,25 +932,12 @@ public:
         return *this;
     }
 
-    bool setup()
+    // Uploads the vertices converted to the packed attribute types, for example
+    // setupPacked<glm::vec3, PackedNormal, HalfTexcoord>()
+    template <class... PackedTypes>
+    bool setupPacked()
     {
-        if (!this->setupRenderableBuffer(this->_verts.size()))
-            return false;
-
-        glBindVertexArray(this->_vertexArrayId);
-        glBindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
-
-        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, NormalType, TexcoordType, ColorType>)), 0, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(this->_verts.size() * sizeof(Vertex<PositionType, NormalType, TexcoordType, ColorType>)), reinterpret_cast<const GLvoid*>(&this->_verts[0]));
-
-        this->_shader.setupAttributes();
-
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        this->_verts.clear();
-
-        return true;
+        return this->template setupPackedVertices<VertexLayout<PositionType, NormalType, TexcoordType, ColorType>, VertexLayout<PackedTypes...>>();
     }
 
 public:
@@ -330,21 +975,17 @@ public:
 };
 
 template <class PositionType, class NormalType, class TexcoordType, class ColorType, class BoneType>
-class VertexBuffer<PositionType, NormalType, TexcoordType, ColorType, BoneType> : public RenderableBuffer
+class VertexBuffer<PositionType, NormalType, TexcoordType, ColorType, BoneType> : public VertexBuilder<Vertex<PositionType, NormalType, TexcoordType, ColorType, BoneType>, Shader<PositionType, NormalType, TexcoordType, ColorType, BoneType>>
 {
-    const Shader<PositionType, NormalType, TexcoordType, ColorType, BoneType>& _shader;
-    std::vector<Vertex<PositionType, NormalType, TexcoordType, ColorType, BoneType>> _verts;
     NormalType _nextNormal;
     TexcoordType _nextTexcoord;
     ColorType _nextColor;
     BoneType _nextBone;
 
 public:
-    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType, ColorType, BoneType>& shader) : _shader(shader) { }
+    VertexBuffer(const Shader<PositionType, NormalType, TexcoordType, ColorType, BoneType>& shader) : VertexBuilder<Vertex<PositionType, NormalType, TexcoordType, ColorType, BoneType>, Shader<PositionType, NormalType, TexcoordType, ColorType, BoneType>>(shader) { }
     virtual ~VertexBuffer() { }
 
-    std::vector<Vertex<PositionType, NormalType, TexcoordType, ColorType, BoneType>>& verts() { return this->_verts; }
-
     VertexBuffer<PositionType, NormalType, TexcoordType, ColorType, BoneType>& operator << (const Vertex<PositionType, NormalType, TexcoordType, ColorType, BoneType>& vertex)
     {
         this->_verts.push_back(vertex);
@@ -353,27 +994,12 @@ public:
         return *this;
     }
 
-    bool setup()
+    // Uploads the vertices converted to the packed attribute types, for example
+    // setupPacked<glm::vec3, PackedNormal, HalfTexcoord>()
+    template <class... PackedTypes>
+    bool setupPacked()
     {
-        auto vertexSize = sizeof(PositionType) + sizeof(NormalType) + sizeof(TexcoordType) + sizeof(ColorType) + sizeof(BoneType);
-
-        if (!this->setupRenderableBuffer(this->_verts.size()))
-            return false;
-
-        glBindVertexArray(this->_vertexArrayId);
-        glBindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
-
-        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(this->_verts.size() * vertexSize), 0, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(this->_verts.size() * vertexSize), reinterpret_cast<const GLvoid*>(&this->_verts[0]));
-
-        this->_shader.setupAttributes();
-
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        this->_verts.clear();
-
-        return true;
+        return this->template setupPackedVertices<VertexLayout<PositionType, NormalType, TexcoordType, ColorType, BoneType>, VertexLayout<PackedTypes...>>();
     }
 
 public:
@@ -410,11 +1036,201 @@ public:
         return *this;
     }
 
-    VertexBuffer<PositionType, NormalType, TexcoordType, ColorType>& bone(const BoneType& bone)
+    VertexBuffer<PositionType, NormalType, TexcoordType, ColorType, BoneType>& bone(const BoneType& bone)
     {
         this->_nextBone = bone;
         return *this;
     }
 };
 
+// Vertex buffer for your own vertex struct, its members must match the layout of the shader
+template <class VertexType, class ShaderType>
+class LayoutVertexBuffer : public VertexBuilder<VertexType, ShaderType>
+{
+    static_assert(sizeof(VertexType) == ShaderType::layout::stride, "Vertex type does not match the shader layout");
+
+public:
+    LayoutVertexBuffer(const ShaderType& shader) : VertexBuilder<VertexType, ShaderType>(shader) { }
+    virtual ~LayoutVertexBuffer() { }
+
+    LayoutVertexBuffer<VertexType, ShaderType>& operator << (const VertexType& vertex)
+    {
+        this->_verts.push_back(vertex);
+        this->_vertexCount = this->_verts.size();
+
+        return *this;
+    }
+
+    template <class... PackedTypes>
+    bool setupPacked()
+    {
+        return this->template setupPackedVertices<typename ShaderType::layout, VertexLayout<PackedTypes...>>();
+    }
+};
+
+// Vertex buffer for geometry that changes every frame. Vertices are written straight into mapped
+// memory between begin() and end(). With buffer storage the buffer is persistently mapped and split
+// in three regions used round robin, each guarded by a fence so we never write where the gpu still
+// reads. Without it the buffer is orphaned and mapped again every frame.
+template <class... Types>
+class StreamingVertexBuffer : public RenderableBuffer
+{
+    static const int RegionCount = 3;
+
+    const Shader<Types...>& _shader;
+    GLsync _fences[RegionCount];
+    Vertex<Types...>* _mapped;
+    Vertex<Types...>* _current;
+    int _regionSize;
+    int _region;
+    int _written;
+    int _dropped;
+    bool _persistent;
+    bool _drawn;
+
+public:
+    StreamingVertexBuffer(const Shader<Types...>& shader)
+        : _shader(shader), _mapped(nullptr), _current(nullptr), _regionSize(0), _region(0), _written(0), _dropped(0), _persistent(false), _drawn(false)
+    {
+        for (int i = 0; i < RegionCount; i++) this->_fences[i] = 0;
+    }
+    virtual ~StreamingVertexBuffer() { }
+
+    bool setup(int maxVertexCount)
+    {
+        if (!this->setupRenderableBuffer(0))
+            return false;
+
+        this->_regionSize = maxVertexCount;
+
+        GLState::current().bindVertexArray(this->_vertexArrayId);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+
+#if !defined(__ANDROID__) && defined(GL_MAP_PERSISTENT_BIT)
+        this->_persistent = Extensions::hasBufferStorage();
+        if (this->_persistent)
+        {
+            auto size = GLsizeiptr(RegionCount * maxVertexCount * sizeof(Vertex<Types...>));
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+            this->_mapped = reinterpret_cast<Vertex<Types...>*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+            this->_persistent = this->_mapped != nullptr;
+        }
+#endif
+        if (!this->_persistent)
+        {
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(maxVertexCount * sizeof(Vertex<Types...>)), nullptr, GL_STREAM_DRAW);
+        }
+
+        this->_shader.setupAttributes();
+
+        GLState::current().bindVertexArray(0);
+        GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return true;
+    }
+
+    // Starts writing the next frame, waits when the gpu is still reading the region we are about to reuse
+    void begin()
+    {
+        this->_written = 0;
+        this->_dropped = 0;
+
+        if (this->_persistent)
+        {
+            if (this->_drawn)
+            {
+                this->_fences[this->_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                this->_region = (this->_region + 1) % RegionCount;
+            }
+
+            auto fence = this->_fences[this->_region];
+            if (fence != 0)
+            {
+                GLenum result = glClientWaitSync(fence, 0, 0);
+                while (result == GL_TIMEOUT_EXPIRED)
+                {
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                }
+                glDeleteSync(fence);
+                this->_fences[this->_region] = 0;
+            }
+
+            this->_current = this->_mapped + this->_region * this->_regionSize;
+        }
+        else
+        {
+            auto size = GLsizeiptr(this->_regionSize * sizeof(Vertex<Types...>));
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+            glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            this->_current = reinterpret_cast<Vertex<Types...>*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        }
+        this->_drawn = false;
+    }
+
+    // Reserves room for count vertices in mapped memory, returns nullptr when the region is full. The
+    // refused vertices, also those of operator <<, are counted in dropped() until the next begin().
+    Vertex<Types...>* allocate(int count)
+    {
+        if (this->_current == nullptr || this->_written + count > this->_regionSize)
+        {
+            this->_dropped += count;
+            return nullptr;
+        }
+
+        auto result = this->_current + this->_written;
+        this->_written += count;
+
+        return result;
+    }
+
+    // Drops the vertex when the region is full, see dropped()
+    StreamingVertexBuffer<Types...>& operator << (const Vertex<Types...>& vertex)
+    {
+        auto target = this->allocate(1);
+        if (target != nullptr) *target = vertex;
+
+        return *this;
+    }
+
+    int dropped() const { return this->_dropped; }
+
+    // Finishes the frame, render() draws what was written since begin()
+    void end()
+    {
+        if (!this->_persistent && this->_current != nullptr)
+        {
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        this->_current = nullptr;
+
+        this->_firstVertex = this->_persistent ? this->_region * this->_regionSize : 0;
+        this->_vertexCount = this->_written;
+        this->_drawn = true;
+    }
+
+    virtual void cleanup()
+    {
+        for (int i = 0; i < RegionCount; i++)
+        {
+            if (this->_fences[i] != 0) glDeleteSync(this->_fences[i]);
+            this->_fences[i] = 0;
+        }
+        // Persistent buffers stay mapped, others only between begin() and end()
+        if (this->_mapped != nullptr || this->_current != nullptr)
+        {
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->_vertexBufferId);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            GLState::current().bindBuffer(GL_ARRAY_BUFFER, 0);
+            this->_mapped = nullptr;
+        }
+        this->_current = nullptr;
+        this->_written = 0;
+        this->_dropped = 0;
+        RenderableBuffer::cleanup();
+    }
+};
+
 #endif // GL_UTILITIES_VERTEXBUFFERS_H
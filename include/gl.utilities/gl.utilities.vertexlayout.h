@@ -0,0 +1,151 @@
+#ifndef GL_UTILITIES_VERTEXLAYOUT_H
+#define GL_UTILITIES_VERTEXLAYOUT_H
+
+#ifdef _WIN32
+#include <glad/glad.h>
+#endif // _WIN32
+
+#ifdef __ANDROID__
+#include <GLES/gl.h>
+#include <GLES3/gl3.h>
+#endif // __ANDROID__
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+// Component type of an attribute type, taken from T::value_type (glm and most vector types), the
+// element type of an array or T itself for scalars. Anything else is assumed to be made of floats.
+template <class T, class = void>
+struct HasValueType : std::false_type { };
+
+template <class T>
+struct HasValueType<T, decltype(void(sizeof(typename T::value_type)))> : std::true_type { };
+
+template <class T, bool = std::is_arithmetic<T>::value, bool = HasValueType<T>::value>
+struct AttributeComponent { typedef float type; };
+
+template <class T, bool HasValue>
+struct AttributeComponent<T, true, HasValue> { typedef T type; };
+
+template <class T>
+struct AttributeComponent<T, false, true> { typedef typename T::value_type type; };
+
+template <class T, size_t N>
+struct AttributeComponent<T[N], false, false> { typedef T type; };
+
+template <class T> struct GLComponentType;
+template <> struct GLComponentType<float> { static constexpr GLenum value = GL_FLOAT; };
+template <> struct GLComponentType<int> { static constexpr GLenum value = GL_INT; };
+template <> struct GLComponentType<unsigned int> { static constexpr GLenum value = GL_UNSIGNED_INT; };
+template <> struct GLComponentType<short> { static constexpr GLenum value = GL_SHORT; };
+template <> struct GLComponentType<unsigned short> { static constexpr GLenum value = GL_UNSIGNED_SHORT; };
+template <> struct GLComponentType<signed char> { static constexpr GLenum value = GL_BYTE; };
+template <> struct GLComponentType<unsigned char> { static constexpr GLenum value = GL_UNSIGNED_BYTE; };
+
+// How a single attribute type is handed to GL. Specialize this for your own types when the
+// deduced component type, count or normalization is not what you want.
+template <class T>
+struct VertexAttribute
+{
+    typedef typename AttributeComponent<T>::type component_type;
+
+    static constexpr GLint components = GLint(sizeof(T) / sizeof(component_type));
+    static constexpr GLenum type = GLComponentType<component_type>::value;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = std::is_integral<component_type>::value;
+};
+
+// Offsets and stride follow the same alignment rules as a struct with the attribute types as members
+template <class... Types>
+struct VertexLayoutMetrics
+{
+    static constexpr size_t alignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+    static constexpr size_t offset(size_t index)
+    {
+        const size_t sizes[] = { sizeof(Types)... };
+        const size_t alignments[] = { alignof(Types)... };
+
+        size_t result = 0;
+        for (size_t i = 0; i < index; i++) result = alignUp(result, alignments[i]) + sizes[i];
+
+        return alignUp(result, alignments[index]);
+    }
+
+    static constexpr size_t stride()
+    {
+        const size_t sizes[] = { sizeof(Types)... };
+        const size_t alignments[] = { alignof(Types)... };
+
+        size_t result = 0, maxAlignment = 1;
+        for (size_t i = 0; i < sizeof...(Types); i++)
+        {
+            result = alignUp(result, alignments[i]) + sizes[i];
+            maxAlignment = alignments[i] > maxAlignment ? alignments[i] : maxAlignment;
+        }
+
+        return alignUp(result, maxAlignment);
+    }
+};
+
+// Compile time description of an interleaved vertex
+template <class... Types>
+class VertexLayout
+{
+    template <size_t Index>
+    static void setupAttribute(GLint location)
+    {
+        typedef VertexAttribute<typename std::tuple_element<Index, std::tuple<Types...>>::type> attribute;
+        constexpr auto offset = VertexLayoutMetrics<Types...>::offset(Index);
+
+        if (location < 0) return;
+
+        if (attribute::integer && !attribute::normalized)
+        {
+            glVertexAttribIPointer(GLuint(location), attribute::components, attribute::type, stride, reinterpret_cast<const GLvoid*>(offset));
+        }
+        else
+        {
+            glVertexAttribPointer(GLuint(location), attribute::components, attribute::type, attribute::normalized, stride, reinterpret_cast<const GLvoid*>(offset));
+        }
+        glEnableVertexAttribArray(GLuint(location));
+    }
+
+    template <size_t... Indices>
+    static void setupAttributes(const GLint locations[], std::index_sequence<Indices...>)
+    {
+        int expand[] = { 0, (setupAttribute<Indices>(locations[Indices]), 0)... };
+        (void)expand;
+    }
+
+public:
+    static constexpr size_t count = sizeof...(Types);
+    static constexpr GLsizei stride = GLsizei(VertexLayoutMetrics<Types...>::stride());
+
+    template <size_t Index>
+    using type = typename std::tuple_element<Index, std::tuple<Types...>>::type;
+
+    template <size_t Index>
+    using attribute = VertexAttribute<type<Index>>;
+
+    static constexpr size_t offset(size_t index) { return VertexLayoutMetrics<Types...>::offset(index); }
+
+    // Sets up the attribute pointers for the bound vertex array and GL_ARRAY_BUFFER, attributes with a
+    // negative location are skipped
+    static void setupAttributes(const GLint locations[])
+    {
+        setupAttributes(locations, std::index_sequence_for<Types...>());
+    }
+
+    static void setupAttributes(GLuint program, const std::string* const names[])
+    {
+        GLint locations[sizeof...(Types)];
+        for (size_t i = 0; i < sizeof...(Types); i++) locations[i] = glGetAttribLocation(program, names[i]->c_str());
+
+        setupAttributes(locations);
+    }
+};
+
+#endif // GL_UTILITIES_VERTEXLAYOUT_H
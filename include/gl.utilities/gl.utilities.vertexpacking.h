@@ -0,0 +1,320 @@
+#ifndef GL_UTILITIES_VERTEXPACKING_H
+#define GL_UTILITIES_VERTEXPACKING_H
+
+#include "gl.utilities.simd.h"
+#include "gl.utilities.vertexlayout.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// Packed attribute types, use them in the layout passed to setupPacked() while the builder keeps
+// working with the float types. The conversion runs once per attribute over all vertices, four
+// vertices at a time.
+
+// Normal as signed normalized 10:10:10:2, read it as vec4 (or vec3) in the shader
+struct PackedNormal { uint32_t value; };
+
+// Normal as octahedral snorm16, decode it in the shader
+struct OctahedralNormal { int16_t value[2]; };
+
+// Texcoord as two half floats
+struct HalfTexcoord { uint16_t value[2]; };
+
+// Color as normalized unsigned bytes
+struct UnormColor { uint8_t value[4]; };
+
+// Bone indices as integer unsigned bytes, read as uvec4 in the shader
+struct ByteBones { uint8_t value[4]; };
+
+// Bone weights as normalized unsigned bytes
+struct UnormWeights { uint8_t value[4]; };
+
+template <> struct VertexAttribute<PackedNormal>
+{
+    static constexpr GLint components = 4;
+    static constexpr GLenum type = GL_INT_2_10_10_10_REV;
+    static constexpr GLboolean normalized = GL_TRUE;
+    static constexpr bool integer = false;
+};
+
+template <> struct VertexAttribute<OctahedralNormal>
+{
+    static constexpr GLint components = 2;
+    static constexpr GLenum type = GL_SHORT;
+    static constexpr GLboolean normalized = GL_TRUE;
+    static constexpr bool integer = false;
+};
+
+template <> struct VertexAttribute<HalfTexcoord>
+{
+    static constexpr GLint components = 2;
+    static constexpr GLenum type = GL_HALF_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
+};
+
+template <> struct VertexAttribute<UnormColor>
+{
+    static constexpr GLint components = 4;
+    static constexpr GLenum type = GL_UNSIGNED_BYTE;
+    static constexpr GLboolean normalized = GL_TRUE;
+    static constexpr bool integer = false;
+};
+
+template <> struct VertexAttribute<ByteBones>
+{
+    static constexpr GLint components = 4;
+    static constexpr GLenum type = GL_UNSIGNED_BYTE;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = true;
+};
+
+template <> struct VertexAttribute<UnormWeights> : VertexAttribute<UnormColor> { };
+
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int32_t exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) return uint16_t(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    if (exponent >= 31) return uint16_t(sign | 0x7C00);
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return uint16_t(sign);
+
+        mantissa |= 0x800000;
+        auto shift = uint32_t(14 - exponent);
+        auto half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+
+        return uint16_t(sign | half);
+    }
+
+    auto half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+
+    return uint16_t(half);
+}
+
+// Converts one attribute of count vertices from a strided source to a strided destination. Packing an
+// attribute into its own type is a plain copy.
+template <class Source, class Packed>
+struct AttributePacker
+{
+    static_assert(std::is_same<Source, Packed>::value, "There is no packer for this combination of attribute types");
+
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) std::memcpy(dst + i * dstStride, src + i * srcStride, sizeof(Packed));
+    }
+};
+
+// Loads one float attribute of up to four vertices transposed, so lane i of components[c] holds
+// component c of vertex i. Missing components and vertices are filled in.
+template <class Source>
+struct FloatAttribute
+{
+    static_assert(std::is_same<typename VertexAttribute<Source>::component_type, float>::value, "Packed attributes need a float source");
+
+    static constexpr int components = VertexAttribute<Source>::components;
+
+    static void load(const unsigned char* src, size_t srcStride, size_t count, Float4 result[4], float fill)
+    {
+        float lanes[4][4] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { fill, fill, fill, fill } };
+        for (size_t i = 0; i < count; i++)
+        {
+            float value[4];
+            std::memcpy(value, src + i * srcStride, sizeof(float) * (components < 4 ? components : 4));
+            for (int c = 0; c < (components < 4 ? components : 4); c++) lanes[c][i] = value[c];
+        }
+        for (int c = 0; c < 4; c++) result[c] = simdLoad(lanes[c]);
+    }
+};
+
+inline Float4 simdClamp(Float4 value, float low, float high) { return simdMin(simdMax(value, simdSet1(low)), simdSet1(high)); }
+inline Float4 simdAbs(Float4 value) { return simdMax(value, simdSub(simdSet1(0.0f), value)); }
+
+// The packers convert four vertices per iteration, every attribute component in its own register
+template <class Source>
+struct AttributePacker<Source, PackedNormal>
+{
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            auto n = count - first < 4 ? count - first : 4;
+            Float4 normal[4];
+            FloatAttribute<Source>::load(src + first * srcStride, srcStride, n, normal, 0.0f);
+
+            int32_t q[4][4];
+            for (int c = 0; c < 3; c++) simdStoreRounded(q[c], simdMul(simdClamp(normal[c], -1.0f, 1.0f), simdSet1(511.0f)));
+            simdStoreRounded(q[3], simdClamp(normal[3], -1.0f, 1.0f));
+
+            for (size_t i = 0; i < n; i++)
+            {
+                uint32_t packed = (uint32_t(q[0][i]) & 0x3FF) | ((uint32_t(q[1][i]) & 0x3FF) << 10) | ((uint32_t(q[2][i]) & 0x3FF) << 20) | ((uint32_t(q[3][i]) & 0x3) << 30);
+                std::memcpy(dst + (first + i) * dstStride, &packed, sizeof(packed));
+            }
+        }
+    }
+};
+
+template <class Source>
+struct AttributePacker<Source, OctahedralNormal>
+{
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        const auto zero = simdSet1(0.0f), one = simdSet1(1.0f), minusOne = simdSet1(-1.0f);
+        for (size_t first = 0; first < count; first += 4)
+        {
+            auto n = count - first < 4 ? count - first : 4;
+            Float4 normal[4];
+            FloatAttribute<Source>::load(src + first * srcStride, srcStride, n, normal, 0.0f);
+
+            // Project on the octahedron, the lower half is folded over the diagonals
+            auto length = simdAdd(simdAbs(normal[0]), simdAdd(simdAbs(normal[1]), simdAbs(normal[2])));
+            length = simdSelectLessThan(zero, length, length, one);
+            auto x = simdDiv(normal[0], length), y = simdDiv(normal[1], length);
+            auto wrappedX = simdMul(simdSub(one, simdAbs(y)), simdSelectLessThan(x, zero, minusOne, one));
+            auto wrappedY = simdMul(simdSub(one, simdAbs(x)), simdSelectLessThan(y, zero, minusOne, one));
+            x = simdSelectLessThan(normal[2], zero, wrappedX, x);
+            y = simdSelectLessThan(normal[2], zero, wrappedY, y);
+
+            int32_t q[2][4];
+            simdStoreRounded(q[0], simdMul(simdClamp(x, -1.0f, 1.0f), simdSet1(32767.0f)));
+            simdStoreRounded(q[1], simdMul(simdClamp(y, -1.0f, 1.0f), simdSet1(32767.0f)));
+
+            for (size_t i = 0; i < n; i++)
+            {
+                int16_t packed[2] = { int16_t(q[0][i]), int16_t(q[1][i]) };
+                std::memcpy(dst + (first + i) * dstStride, packed, sizeof(packed));
+            }
+        }
+    }
+};
+
+template <class Source>
+struct AttributePacker<Source, HalfTexcoord>
+{
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            auto n = count - first < 4 ? count - first : 4;
+            Float4 uv[4];
+            FloatAttribute<Source>::load(src + first * srcStride, srcStride, n, uv, 0.0f);
+
+            uint16_t halfs[2][4];
+#ifdef GL_UTILITIES_F16C
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(halfs[0]), _mm_cvtps_ph(uv[0].v, _MM_FROUND_TO_NEAREST_INT));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(halfs[1]), _mm_cvtps_ph(uv[1].v, _MM_FROUND_TO_NEAREST_INT));
+#else
+            for (int c = 0; c < 2; c++)
+            {
+                float lanes[4];
+                simdStore(lanes, uv[c]);
+                for (int i = 0; i < 4; i++) halfs[c][i] = floatToHalf(lanes[i]);
+            }
+#endif
+            for (size_t i = 0; i < n; i++)
+            {
+                uint16_t packed[2] = { halfs[0][i], halfs[1][i] };
+                std::memcpy(dst + (first + i) * dstStride, packed, sizeof(packed));
+            }
+        }
+    }
+};
+
+// Clamps four components of four vertices to [0, 1] and stores them as normalized bytes
+inline void packUnorm4(const Float4 components[4], float scale, unsigned char* dst, size_t dstStride, size_t count)
+{
+    int32_t q[4][4];
+    for (int c = 0; c < 4; c++) simdStoreRounded(q[c], simdMul(simdClamp(components[c], 0.0f, scale), simdSet1(255.0f / scale)));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t packed[4] = { uint8_t(q[0][i]), uint8_t(q[1][i]), uint8_t(q[2][i]), uint8_t(q[3][i]) };
+        std::memcpy(dst + i * dstStride, packed, sizeof(packed));
+    }
+}
+
+template <class Source>
+struct UnormPacker
+{
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            auto n = count - first < 4 ? count - first : 4;
+            Float4 color[4];
+            FloatAttribute<Source>::load(src + first * srcStride, srcStride, n, color, 1.0f);
+            packUnorm4(color, 1.0f, dst + first * dstStride, dstStride, n);
+        }
+    }
+};
+
+template <class Source> struct AttributePacker<Source, UnormColor> : UnormPacker<Source> { };
+template <class Source> struct AttributePacker<Source, UnormWeights> : UnormPacker<Source> { };
+
+// Bone indices may be stored as floats or integers, they are converted to float lanes and clamped to
+// [0, 255] like the colors
+template <class Source>
+struct AttributePacker<Source, ByteBones>
+{
+    typedef typename VertexAttribute<Source>::component_type component_type;
+    static constexpr int components = VertexAttribute<Source>::components;
+
+    static void pack(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t count)
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            auto n = count - first < 4 ? count - first : 4;
+            float lanes[4][4] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } };
+            for (size_t i = 0; i < n; i++)
+            {
+                component_type bones[4] = { 0, 0, 0, 0 };
+                std::memcpy(bones, src + (first + i) * srcStride, sizeof(component_type) * (components < 4 ? components : 4));
+                for (int c = 0; c < 4; c++) lanes[c][i] = float(bones[c]);
+            }
+
+            Float4 bones[4];
+            for (int c = 0; c < 4; c++) bones[c] = simdLoad(lanes[c]);
+            packUnorm4(bones, 255.0f, dst + first * dstStride, dstStride, n);
+        }
+    }
+};
+
+// Converts count vertices from the source layout into the packed layout, one attribute at a time
+template <class SourceLayout, class PackedLayout>
+class VertexPacker
+{
+    static_assert(SourceLayout::count == PackedLayout::count, "Source and packed layouts need the same attribute count");
+
+    template <size_t Index>
+    static void packAttribute(const unsigned char* src, unsigned char* dst, size_t count)
+    {
+        AttributePacker<typename SourceLayout::template type<Index>, typename PackedLayout::template type<Index>>::pack(
+                    src + SourceLayout::offset(Index), SourceLayout::stride,
+                    dst + PackedLayout::offset(Index), PackedLayout::stride, count);
+    }
+
+    template <size_t... Indices>
+    static void pack(const unsigned char* src, unsigned char* dst, size_t count, std::index_sequence<Indices...>)
+    {
+        int expand[] = { 0, (packAttribute<Indices>(src, dst, count), 0)... };
+        (void)expand;
+    }
+
+public:
+    static void pack(const void* src, void* dst, size_t count)
+    {
+        pack(reinterpret_cast<const unsigned char*>(src), reinterpret_cast<unsigned char*>(dst), count, std::make_index_sequence<SourceLayout::count>());
+    }
+};
+
+#endif // GL_UTILITIES_VERTEXPACKING_H
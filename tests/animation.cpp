@@ -0,0 +1,166 @@
+// Evaluates random skeletons with PaletteEvaluator, one character at a time and spread over a ThreadPool,
+// and compares the full and compact palettes with a plain scalar evaluation of the same poses.
+
+#include <gl.utilities/gl.utilities.animation.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static uint32_t noise = 2463534242u;
+
+static float random(float minimum, float maximum)
+{
+    noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5;
+    return minimum + (maximum - minimum) * float(noise % 100000) / 100000.0f;
+}
+
+// Column major result = a * b
+static void multiply(const float a[], const float b[], float result[])
+{
+    float product[16];
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            product[column * 4 + row] = 0.0f;
+            for (int k = 0; k < 4; k++) product[column * 4 + row] += a[k * 4 + row] * b[column * 4 + k];
+        }
+    }
+    for (int i = 0; i < 16; i++) result[i] = product[i];
+}
+
+// Translation * rotation * scale of one bone, one element at a time
+static void localMatrix(const LocalPose& pose, size_t bone, float m[])
+{
+    auto x = pose.rotationX[bone], y = pose.rotationY[bone], z = pose.rotationZ[bone], w = pose.rotationW[bone];
+    const float rotation[9] = {
+        1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y),
+        2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x),
+        2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y),
+    };
+    const float scale[3] = { pose.scaleX[bone], pose.scaleY[bone], pose.scaleZ[bone] };
+
+    for (int column = 0; column < 3; column++)
+    {
+        for (int row = 0; row < 3; row++) m[column * 4 + row] = rotation[column * 3 + row] * scale[column];
+        m[column * 4 + 3] = 0.0f;
+    }
+    m[12] = pose.translationX[bone];
+    m[13] = pose.translationY[bone];
+    m[14] = pose.translationZ[bone];
+    m[15] = 1.0f;
+}
+
+static std::vector<float> reference(const Skeleton& skeleton, const LocalPose& pose)
+{
+    auto boneCount = skeleton.boneCount();
+    std::vector<float> globals(boneCount * 16), palette(boneCount * 16);
+    for (size_t bone = 0; bone < boneCount; bone++)
+    {
+        localMatrix(pose, bone, &globals[bone * 16]);
+        auto parent = skeleton.parents[bone];
+        if (parent >= 0) multiply(&globals[size_t(parent) * 16], &globals[bone * 16], &globals[bone * 16]);
+        multiply(&globals[bone * 16], &skeleton.inverseBindPoses[bone * 16], &palette[bone * 16]);
+    }
+    return palette;
+}
+
+// A chain of bones with random branches, bind poses and local poses
+static void randomCharacter(size_t boneCount, Skeleton& skeleton, LocalPose& pose)
+{
+    skeleton.parents.resize(boneCount);
+    skeleton.inverseBindPoses.assign(boneCount * 16, 0.0f);
+    pose.resize(boneCount);
+    for (size_t bone = 0; bone < boneCount; bone++)
+    {
+        skeleton.parents[bone] = bone == 0 ? -1 : int(random(0.0f, float(bone) - 0.01f));
+
+        auto inverseBindPose = &skeleton.inverseBindPoses[bone * 16];
+        for (int i = 0; i < 16; i++) inverseBindPose[i] = i % 5 == 0 ? 1.0f : 0.0f;
+        for (int i = 12; i < 15; i++) inverseBindPose[i] = random(-1.0f, 1.0f);
+
+        float q[4] = { random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f) };
+        auto length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        pose.rotationX[bone] = q[0] / length;
+        pose.rotationY[bone] = q[1] / length;
+        pose.rotationZ[bone] = q[2] / length;
+        pose.rotationW[bone] = q[3] / length;
+        pose.translationX[bone] = random(-0.5f, 0.5f);
+        pose.translationY[bone] = random(-0.5f, 0.5f);
+        pose.translationZ[bone] = random(-0.5f, 0.5f);
+        pose.scaleX[bone] = random(0.8f, 1.2f);
+        pose.scaleY[bone] = random(0.8f, 1.2f);
+        pose.scaleZ[bone] = random(0.8f, 1.2f);
+    }
+}
+
+static float maxDifference(const std::vector<float>& expected, const float* palette, bool compact)
+{
+    float difference = 0.0f;
+    for (size_t bone = 0; bone < expected.size() / 16; bone++)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < (compact ? 3 : 4); row++)
+            {
+                auto value = compact ? palette[bone * 12 + size_t(row * 4 + column)] : palette[bone * 16 + size_t(column * 4 + row)];
+                difference = std::fmax(difference, std::fabs(value - expected[bone * 16 + size_t(column * 4 + row)]));
+            }
+        }
+    }
+    return difference;
+}
+
+static void testCharacters(ThreadPool* pool)
+{
+    const size_t boneCounts[] = { 1, 3, 4, 23, 64 };
+    std::vector<Skeleton> skeletons(5);
+    std::vector<LocalPose> poses(5);
+    std::vector<std::vector<float>> palettes(10);
+    std::vector<AnimatedCharacter> characters;
+    for (size_t i = 0; i < 5; i++)
+    {
+        randomCharacter(boneCounts[i], skeletons[i], poses[i]);
+        palettes[i * 2].assign(boneCounts[i] * 16, 0.0f);
+        palettes[i * 2 + 1].assign(boneCounts[i] * 12, 0.0f);
+        characters.push_back({ &skeletons[i], &poses[i], palettes[i * 2].data(), false });
+        characters.push_back({ &skeletons[i], &poses[i], palettes[i * 2 + 1].data(), true });
+    }
+
+    PaletteEvaluator evaluator(pool);
+    evaluator.evaluate(characters);
+
+    float full = 0.0f, compact = 0.0f;
+    for (size_t i = 0; i < 5; i++)
+    {
+        auto expected = reference(skeletons[i], poses[i]);
+        full = std::fmax(full, maxDifference(expected, palettes[i * 2].data(), false));
+        compact = std::fmax(compact, maxDifference(expected, palettes[i * 2 + 1].data(), true));
+    }
+    check(full < 1e-4f, "the full palettes match the scalar reference");
+    check(compact < 1e-4f, "the compact palettes match the rows of the scalar reference");
+}
+
+int main()
+{
+    testCharacters(nullptr);
+
+    ThreadPool pool(2);
+    testCharacters(&pool);
+
+    if (failures == 0) std::printf("All animation tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
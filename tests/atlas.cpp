@@ -0,0 +1,107 @@
+// Packs rectangles with SkylinePacker and checks where they are placed, that none overlap or leave the
+// bin, that a filled row of the skyline is packed on as one segment and that full or empty rectangles
+// are refused.
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.atlas.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct Rect
+{
+    int x, y, width, height;
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static void testPlacement()
+{
+    SkylinePacker packer;
+    packer.setup(128, 128);
+
+    int x = -1, y = -1;
+    check(packer.insert(32, 16, x, y) && x == 0 && y == 0, "the first rectangle goes to the bottom left");
+    check(packer.insert(32, 8, x, y) && x == 32 && y == 0, "the next one goes beside it on the lowest segment");
+    check(packer.insert(64, 8, x, y) && x == 64 && y == 0, "the rest of the bottom row is used before going up");
+    check(packer.insert(16, 16, x, y) && x == 32 && y == 8, "a rectangle goes on the lowest segment it fits on");
+}
+
+static void testMerge()
+{
+    SkylinePacker packer;
+    packer.setup(128, 64);
+
+    int x = -1, y = -1;
+    for (int i = 0; i < 4; i++) packer.insert(32, 16, x, y);
+    check(packer.insert(128, 16, x, y) && x == 0 && y == 16, "a filled row of equal segments is packed on as one");
+    check(packer.insert(128, 32, x, y) && x == 0 && y == 32, "the bin can be filled to the top");
+    check(!packer.insert(1, 1, x, y), "a full bin refuses more rectangles");
+}
+
+static void testNoOverlap()
+{
+    SkylinePacker packer;
+    packer.setup(256, 256);
+
+    uint32_t noise = 2463534242u;
+    auto next = [&noise] () { noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5; return noise; };
+
+    std::vector<Rect> placed;
+    long area = 0;
+    for (int i = 0; i < 400; i++)
+    {
+        Rect rect = { 0, 0, 4 + int(next() % 28), 4 + int(next() % 28) };
+        if (!packer.insert(rect.width, rect.height, rect.x, rect.y)) continue;
+        placed.push_back(rect);
+        area += long(rect.width) * long(rect.height);
+    }
+
+    bool inside = true, overlap = false;
+    for (size_t i = 0; i < placed.size(); i++)
+    {
+        auto& a = placed[i];
+        inside = inside && a.x >= 0 && a.y >= 0 && a.x + a.width <= 256 && a.y + a.height <= 256;
+        for (size_t j = i + 1; j < placed.size(); j++)
+        {
+            auto& b = placed[j];
+            if (a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height) overlap = true;
+        }
+    }
+    check(inside, "every rectangle lies inside the bin");
+    check(!overlap, "no two rectangles overlap");
+    check(area > 256 * 256 * 6 / 10, "random rectangles fill more than 60% of the bin");
+}
+
+static void testRefused()
+{
+    SkylinePacker packer;
+    packer.setup(64, 64);
+
+    int x = -1, y = -1;
+    check(!packer.insert(0, 8, x, y) && !packer.insert(8, 0, x, y) && !packer.insert(-4, 8, x, y), "empty rectangles are refused");
+    check(!packer.insert(65, 8, x, y) && !packer.insert(8, 65, x, y), "rectangles larger than the bin are refused");
+    check(packer.insert(64, 64, x, y) && x == 0 && y == 0, "a rectangle the size of the bin fits after refused ones");
+}
+
+int main()
+{
+    testPlacement();
+    testMerge();
+    testNoOverlap();
+    testRefused();
+
+    if (failures == 0) std::printf("All atlas tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+// Builds KTX, KTX2 and DDS files in memory and checks the format, size and levels CompressedTextureLoader
+// finds in them, and that truncated files, unsupported layouts and unknown formats are refused.
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.compressedtextures.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static void write32(std::vector<unsigned char>& file, size_t offset, uint32_t value)
+{
+    std::memcpy(&file[offset], &value, sizeof(value));
+}
+
+static void write64(std::vector<unsigned char>& file, size_t offset, uint64_t value)
+{
+    std::memcpy(&file[offset], &value, sizeof(value));
+}
+
+static bool parse(const std::vector<unsigned char>& file, CompressedTextureLoader::Image& image)
+{
+    return CompressedTextureLoader::parse(file.data(), file.size(), image);
+}
+
+// An 8x8 BC1 texture with two levels and 8 bytes of key value data
+static std::vector<unsigned char> ktx()
+{
+    static const unsigned char identifier[] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    std::vector<unsigned char> file(64 + 8 + 4 + 32 + 4 + 8, 0);
+    std::memcpy(&file[0], identifier, sizeof(identifier));
+    write32(file, 12, 0x04030201);
+    write32(file, 28, 0x83F1);
+    write32(file, 36, 8);
+    write32(file, 40, 8);
+    write32(file, 52, 1);
+    write32(file, 56, 2);
+    write32(file, 60, 8);
+    write32(file, 72, 32);
+    write32(file, 108, 8);
+    return file;
+}
+
+// A 16x8 ASTC 4x4 texture with two levels, the smaller level stored first
+static std::vector<unsigned char> ktx2()
+{
+    static const unsigned char identifier[] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    std::vector<unsigned char> file(80 + 2 * 24 + 32 + 128, 0);
+    std::memcpy(&file[0], identifier, sizeof(identifier));
+    write32(file, 12, 157);
+    write32(file, 20, 16);
+    write32(file, 24, 8);
+    write32(file, 36, 1);
+    write32(file, 40, 2);
+    write64(file, 80, 160);
+    write64(file, 88, 128);
+    write64(file, 104, 128);
+    write64(file, 112, 32);
+    return file;
+}
+
+// A 16x8 texture with three levels, either DXT5 or BC7 behind a DX10 header
+static std::vector<unsigned char> dds(bool dx10)
+{
+    auto offset = size_t(dx10 ? 148 : 128);
+    std::vector<unsigned char> file(offset + 128 + 32 + 16, 0);
+    std::memcpy(&file[0], "DDS ", 4);
+    write32(file, 4, 124);
+    write32(file, 12, 8);
+    write32(file, 16, 16);
+    write32(file, 28, 3);
+    write32(file, 76, 32);
+    std::memcpy(&file[84], dx10 ? "DX10" : "DXT5", 4);
+    if (dx10) write32(file, 128, 98);
+    return file;
+}
+
+static void testKtx()
+{
+    auto file = ktx();
+    CompressedTextureLoader::Image image;
+    check(parse(file, image), "a BC1 KTX file is parsed");
+    check(image.format == 0x83F1 && image.width == 8 && image.height == 8, "the KTX format and size are read");
+    check(image.levels.size() == 2, "both KTX levels are found");
+    if (image.levels.size() == 2)
+    {
+        check(image.levels[0].data == file.data() + 76 && image.levels[0].size == 32, "the first KTX level follows the key value data");
+        check(image.levels[1].data == file.data() + 112 && image.levels[1].size == 8, "the second KTX level follows the first");
+        check(image.levels[1].width == 4 && image.levels[1].height == 4, "the second KTX level is half the size");
+    }
+
+    auto truncated = file;
+    truncated.pop_back();
+    check(!parse(truncated, image), "a KTX file cut short in the last level is refused");
+
+    auto bigEndian = file;
+    write32(bigEndian, 12, 0x01020304);
+    check(!parse(bigEndian, image), "a big endian KTX file is refused");
+
+    auto cube = file;
+    write32(cube, 52, 6);
+    check(!parse(cube, image), "a KTX cube map is refused");
+
+    auto uncompressed = file;
+    write32(uncompressed, 16, 0x1401);
+    check(!parse(uncompressed, image), "an uncompressed KTX file is refused");
+}
+
+static void testKtx2()
+{
+    auto file = ktx2();
+    CompressedTextureLoader::Image image;
+    check(parse(file, image), "an ASTC KTX2 file is parsed");
+    check(image.format == 0x93B0 && image.width == 16 && image.height == 8, "the KTX2 format and size are read");
+    check(image.levels.size() == 2, "both KTX2 levels are found");
+    if (image.levels.size() == 2)
+    {
+        check(image.levels[0].data == file.data() + 160 && image.levels[0].size == 128, "the first KTX2 level is read from the level index");
+        check(image.levels[1].data == file.data() + 128 && image.levels[1].size == 32, "the second KTX2 level is read from the level index");
+        check(image.levels[1].width == 8 && image.levels[1].height == 4, "the second KTX2 level is half the size");
+    }
+
+    auto srgb = file;
+    write32(srgb, 12, 158);
+    check(parse(srgb, image) && image.format == 0x93D0, "the sRGB ASTC formats follow the linear ones");
+
+    auto bc7 = file;
+    write32(bc7, 12, 145);
+    check(parse(bc7, image) && image.format == 0x8E8C, "a BC7 KTX2 file is parsed");
+
+    auto unknown = file;
+    write32(unknown, 12, 37);
+    check(!parse(unknown, image), "an uncompressed KTX2 format is refused");
+
+    auto supercompressed = file;
+    write32(supercompressed, 44, 1);
+    check(!parse(supercompressed, image), "a supercompressed KTX2 file is refused");
+
+    auto pastEnd = file;
+    write64(pastEnd, 80, 161);
+    check(!parse(pastEnd, image), "a KTX2 level reaching past the end of the file is refused");
+
+    auto wrapping = file;
+    write64(wrapping, 80, ~uint64_t(0) - 15);
+    write64(wrapping, 88, 32);
+    check(!parse(wrapping, image), "a KTX2 level whose end wraps around is refused");
+
+    auto levelIndex = file;
+    write32(levelIndex, 40, 20);
+    check(!parse(levelIndex, image), "a KTX2 level index longer than the file is refused");
+}
+
+static void testDds()
+{
+    auto file = dds(false);
+    CompressedTextureLoader::Image image;
+    check(parse(file, image), "a DXT5 DDS file is parsed");
+    check(image.format == 0x83F3 && image.width == 16 && image.height == 8, "the DDS format and size are read");
+    check(image.levels.size() == 3, "all DDS levels are found");
+    if (image.levels.size() == 3)
+    {
+        check(image.levels[0].data == file.data() + 128 && image.levels[0].size == 128, "the first DDS level follows the header");
+        check(image.levels[1].size == 32 && image.levels[2].size == 16, "the DDS levels are sized in whole 4x4 blocks");
+        check(image.levels[2].width == 4 && image.levels[2].height == 2, "the last DDS level is a quarter of the size");
+    }
+
+    auto bc1 = file;
+    std::memcpy(&bc1[84], "DXT1", 4);
+    check(parse(bc1, image) && image.levels.size() == 3 && image.levels[0].size == 64, "BC1 DDS levels use 8 bytes per block");
+
+    file = dds(true);
+    check(parse(file, image), "a BC7 DDS file with a DX10 header is parsed");
+    check(image.format == 0x8E8C && image.levels.size() == 3 && image.levels[0].data == file.data() + 148, "the DDS levels follow the DX10 header");
+
+    auto truncated = file;
+    truncated.pop_back();
+    check(!parse(truncated, image), "a DDS file cut short in the last level is refused");
+
+    auto unknown = dds(false);
+    std::memcpy(&unknown[84], "RGBA", 4);
+    check(!parse(unknown, image), "an unknown DDS format is refused");
+
+    auto magic = dds(false);
+    magic[3] = 'X';
+    check(!parse(magic, image), "a file without a known magic is refused");
+
+    check(!parse(std::vector<unsigned char>(file.begin(), file.begin() + 100), image), "a DDS header cut short is refused");
+}
+
+int main()
+{
+    testKtx();
+    testKtx2();
+    testDds();
+
+    if (failures == 0) std::printf("All compressed texture tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// Builds mesh files in memory and checks that MeshFile::validate accepts them and refuses wrong magics,
+// versions, vertex layouts and index types, and blobs, levels of detail or faces outside the file.
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.meshfile.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+typedef VertexLayout<float[3], unsigned char[4]> TestLayout;
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static size_t alignUp(size_t value)
+{
+    return (value + 15) / 16 * 16;
+}
+
+// Four vertices of TestLayout, nine short indices split in two levels of detail and two faces, an
+// empty one and the one given to file()
+static MeshFileHeader header()
+{
+    MeshFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "GLUM", 4);
+    header.version = MeshFileHeader::Version;
+    header.stride = 16;
+    header.attributeCount = 2;
+    header.attributes[0] = { 3, GL_FLOAT, 0, 0, 0 };
+    header.attributes[1] = { 4, GL_UNSIGNED_BYTE, 0, 1, 12 };
+    header.drawMode = GL_TRIANGLES;
+    header.indexType = GL_UNSIGNED_SHORT;
+    header.vertexCount = 4;
+    header.indexCount = 9;
+    header.faceCount = 2;
+    header.lodCount = 2;
+    header.vertexOffset = alignUp(sizeof(header));
+    header.indexOffset = header.vertexOffset + 64;
+    header.faceOffset = header.indexOffset + 32;
+    header.lodFirsts[1] = 6;
+    header.lodCounts[0] = 6;
+    header.lodCounts[1] = 3;
+    return header;
+}
+
+static std::vector<unsigned char> file(const MeshFileHeader& header, int32_t first = 6, int32_t count = 3)
+{
+    std::vector<unsigned char> file(alignUp(sizeof(header)) + 64 + 32 + 16, 0);
+    std::memcpy(&file[0], &header, sizeof(header));
+    const int32_t faces[] = { 0, 0, first, count };
+    std::memcpy(&file[file.size() - sizeof(faces)], faces, sizeof(faces));
+    return file;
+}
+
+template <class Layout = TestLayout>
+static bool validate(const std::vector<unsigned char>& file)
+{
+    MeshFileHeader header;
+    return MeshFile::validate<Layout>(file.data(), file.size(), header, "test.mesh");
+}
+
+static void testValid()
+{
+    auto data = file(header());
+    MeshFileHeader read;
+    check(MeshFile::validate<TestLayout>(data.data(), data.size(), read, "test.mesh"), "a mesh file with the expected layout is accepted");
+    check(read.vertexCount == 4 && read.indexCount == 9 && read.lodCount == 2 && read.faceCount == 2, "the header is copied out of the file");
+
+    auto unindexed = header();
+    unindexed.indexType = 0;
+    unindexed.lodCount = 0;
+    check(validate(file(unindexed, 2, 2)), "a file without indices is accepted");
+    check(!validate(file(unindexed, 2, 3)), "faces of a file without indices are checked against the vertices");
+}
+
+static void testHeader()
+{
+    auto data = file(header());
+    check(!validate(std::vector<unsigned char>(data.begin(), data.begin() + sizeof(MeshFileHeader) - 1)), "a file shorter than the header is refused");
+
+    auto magic = header();
+    magic.magic[3] = 'X';
+    check(!validate(file(magic)), "a wrong magic is refused");
+
+    auto version = header();
+    version.version = MeshFileHeader::Version - 1;
+    check(!validate(file(version)), "an older version is refused");
+
+    check(!validate<VertexLayout<float[3]>>(data), "a file with other attributes than the layout is refused");
+    check(!validate<VertexLayout<float[3], float[4]>>(data), "a file with other attribute types than the layout is refused");
+
+    auto normalized = header();
+    normalized.attributes[1].normalized = 1;
+    check(!validate(file(normalized)), "a file with other normalization than the layout is refused");
+
+    auto indexType = header();
+    indexType.indexType = GL_UNSIGNED_BYTE;
+    check(!validate(file(indexType)), "an unsupported index type is refused");
+}
+
+static void testRanges()
+{
+    auto data = file(header());
+    data.pop_back();
+    check(!validate(data), "a file cut short in the faces is refused");
+
+    auto vertices = header();
+    vertices.vertexCount = 8;
+    check(!validate(file(vertices)), "vertices running past the end of the file are refused");
+
+    auto wrapping = header();
+    wrapping.indexOffset = ~uint64_t(0) - 7;
+    check(!validate(file(wrapping)), "an index offset whose end wraps around is refused");
+
+    auto lodCount = header();
+    lodCount.lodCount = MeshFileHeader::MaxLods + 1;
+    check(!validate(file(lodCount)), "more levels of detail than the table holds are refused");
+
+    auto lodRange = header();
+    lodRange.lodCounts[1] = 4;
+    check(!validate(file(lodRange)), "a level of detail past the indices is refused");
+
+    auto lodIndices = header();
+    lodIndices.indexType = 0;
+    check(!validate(file(lodIndices, 0, 3)), "levels of detail without indices are refused");
+
+    check(!validate(file(header(), 6, 4)), "a face past the indices is refused");
+    check(!validate(file(header(), -1, 3)), "a face with a negative first index is refused");
+    check(!validate(file(header(), 0x7FFFFFFF, 0x7FFFFFFF)), "a face whose end overflows is refused");
+}
+
+int main()
+{
+    testValid();
+    testHeader();
+    testRanges();
+
+    if (failures == 0) std::printf("All mesh file tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Runs MeshOptimizer on a shuffled grid, on ranges and on index counts that end in a partial triangle,
+// and checks that the same triangles come out with a better ACMR.
+
+#include <gl.utilities/gl.utilities.meshoptimizer.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct Position
+{
+    typedef float value_type;
+    float x, y, z;
+};
+
+struct TestVertex
+{
+    Position pos;
+};
+
+typedef std::array<float, 9> Triangle;
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static std::vector<TestVertex> gridVertices(int size)
+{
+    std::vector<TestVertex> verts;
+    for (int y = 0; y <= size; y++)
+    {
+        for (int x = 0; x <= size; x++) verts.push_back({ { float(x), float(y), 0.0f } });
+    }
+    return verts;
+}
+
+// The grid's triangles in random order
+static std::vector<unsigned int> gridIndices(int size)
+{
+    std::vector<unsigned int> indices;
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            auto corner = (unsigned int)(y * (size + 1) + x);
+            auto below = corner + (unsigned int)(size + 1);
+            indices.insert(indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    }
+
+    uint32_t noise = 2463534242u;
+    for (auto i = indices.size() / 3; i > 1; i--)
+    {
+        noise ^= noise << 13; noise ^= noise >> 17; noise ^= noise << 5;
+        auto j = size_t(noise % i);
+        for (size_t c = 0; c < 3; c++) std::swap(indices[(i - 1) * 3 + c], indices[j * 3 + c]);
+    }
+    return indices;
+}
+
+// The positions of every triangle with its corners rotated to a fixed start, sorted, so meshes compare
+// equal whatever the triangle and vertex order
+static std::vector<Triangle> triangles(const std::vector<TestVertex>& verts, const std::vector<unsigned int>& indices, size_t first, size_t count)
+{
+    std::vector<Triangle> result;
+    for (size_t i = first; i + 3 <= first + count; i += 3)
+    {
+        std::array<Triangle, 3> rotations;
+        for (size_t r = 0; r < 3; r++)
+        {
+            for (size_t c = 0; c < 3; c++)
+            {
+                auto& p = verts[indices[i + (c + r) % 3]].pos;
+                rotations[r][c * 3] = p.x;
+                rotations[r][c * 3 + 1] = p.y;
+                rotations[r][c * 3 + 2] = p.z;
+            }
+        }
+        result.push_back(*std::min_element(rotations.begin(), rotations.end()));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+static void testGrid()
+{
+    auto verts = gridVertices(32);
+    auto indices = gridIndices(32);
+    auto before = triangles(verts, indices, 0, indices.size());
+
+    MeshOptimizer optimizer;
+    auto stats = optimizer.optimize(verts, indices, std::vector<std::pair<size_t, size_t>>());
+
+    check(stats.acmrAfter < stats.acmrBefore * 0.5f, "the ACMR of a shuffled grid at least halves");
+    check(stats.atvrAfter >= 1.0f && stats.atvrAfter < stats.atvrBefore, "the ATVR improves and stays at least one");
+    check(triangles(verts, indices, 0, indices.size()) == before, "the optimized grid has the same triangles");
+
+    bool sequential = true;
+    unsigned int next = 0;
+    for (auto index : indices)
+    {
+        if (index > next) sequential = false;
+        if (index == next) next++;
+    }
+    check(sequential, "the vertices are numbered in the order they are first used");
+}
+
+static void testRanges()
+{
+    auto verts = gridVertices(16);
+    auto indices = gridIndices(16);
+    auto split = indices.size() / 3 / 2 * 3;
+    auto firstHalf = triangles(verts, indices, 0, split), secondHalf = triangles(verts, indices, split, indices.size() - split);
+
+    MeshOptimizer optimizer;
+    const std::vector<std::pair<size_t, size_t>> ranges = { { 0, split }, { split, indices.size() - split } };
+    optimizer.optimize(verts, indices, ranges);
+
+    check(triangles(verts, indices, 0, split) == firstHalf, "the first range keeps its triangles");
+    check(triangles(verts, indices, split, indices.size() - split) == secondHalf, "the second range keeps its triangles");
+}
+
+static void testPartialTriangle()
+{
+    auto verts = gridVertices(2);
+    std::vector<unsigned int> indices = { 0, 3, 1, 1, 3, 4, 5 };
+    auto before = triangles(verts, indices, 0, 6);
+    auto trailing = verts[indices[6]].pos;
+
+    MeshOptimizer optimizer;
+    optimizer.optimize(verts, indices, std::vector<std::pair<size_t, size_t>>());
+
+    check(indices.size() == 7, "the index count is kept");
+    check(triangles(verts, indices, 0, 6) == before, "the whole triangles are kept when a partial one follows");
+    check(verts[indices[6]].pos.x == trailing.x && verts[indices[6]].pos.y == trailing.y, "the trailing index still addresses the same vertex");
+
+    // A partial triangle in a range of its own is left alone as well
+    std::vector<unsigned int> partial = { 0, 3, 1, 1, 3, 4, 4, 3, 6, 2 };
+    optimizer.reorderTriangles(partial.data(), partial.size(), verts.size());
+    check(partial.back() == 2, "a range ending in a partial triangle keeps its last index");
+}
+
+int main()
+{
+    testGrid();
+    testRanges();
+    testPartialTriangle();
+
+    if (failures == 0) std::printf("All mesh optimizer tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
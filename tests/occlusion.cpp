@@ -0,0 +1,105 @@
+// Renders a wall into OcclusionCuller and checks boxes in front of it, behind it, peeking past its
+// edge and a quad closer than the near plane, serially and split over a ThreadPool.
+
+#include <GL/glcorearb.h>
+
+#include <gl.utilities/gl.utilities.occlusion.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct Position
+{
+    typedef float value_type;
+    float x, y, z;
+};
+
+struct TestVertex
+{
+    Position pos;
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+static void perspective(float fovy, float aspect, float zNear, float zFar, float m[])
+{
+    auto f = 1.0f / std::tan(fovy * 0.5f);
+    for (int i = 0; i < 16; i++) m[i] = 0.0f;
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1.0f;
+    m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+// Two triangles facing the camera at depth z (negative is in front of the camera)
+static std::vector<TestVertex> quad(float halfSize, float z)
+{
+    return {
+        { { -halfSize, -halfSize, z } }, { { halfSize, -halfSize, z } }, { { halfSize, halfSize, z } },
+        { { -halfSize, -halfSize, z } }, { { halfSize, halfSize, z } }, { { -halfSize, halfSize, z } },
+    };
+}
+
+static bool visible(const OcclusionCuller& culler, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+    const float boundsMin[] = { minX, minY, minZ }, boundsMax[] = { maxX, maxY, maxZ };
+    return culler.test(boundsMin, boundsMax);
+}
+
+static void testWall(ThreadPool* pool)
+{
+    const float identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    float viewProjection[16];
+    perspective(1.2f, 2.0f, 1.0f, 100.0f, viewProjection);
+
+    OcclusionCuller culler;
+    culler.setup(256, 128);
+    culler.addOccluder(quad(5.0f, -10.0f), identity);
+    culler.render(viewProjection, pool);
+
+    check(visible(culler, -1.0f, -1.0f, -6.0f, 1.0f, 1.0f, -4.0f), "a box in front of the wall is visible");
+    check(!visible(culler, -1.0f, -1.0f, -21.0f, 1.0f, 1.0f, -19.0f), "a box behind the wall is occluded");
+    check(visible(culler, 8.0f, -1.0f, -21.0f, 12.0f, 1.0f, -19.0f), "a box peeking past the edge of the wall is visible");
+    check(visible(culler, 30.0f, -1.0f, -21.0f, 34.0f, 1.0f, -19.0f), "a box beside the wall is visible");
+    check(visible(culler, -1.0f, -1.0f, 4.0f, 1.0f, 1.0f, 6.0f), "a box behind the camera is not occluded");
+    check(visible(culler, -1.0f, -1.0f, -12.0f, 1.0f, 1.0f, -8.0f), "a box crossing the wall is visible");
+
+    // The quad lies between the camera and the near plane, so it must not hide anything
+    culler.clearOccluders();
+    culler.addOccluder(quad(5.0f, -0.5f), identity);
+    culler.render(viewProjection, pool);
+    check(visible(culler, -1.0f, -1.0f, -21.0f, 1.0f, 1.0f, -19.0f), "a quad closer than the near plane occludes nothing");
+
+    // Half of the quad crossing the near plane is left out as a whole, the rest still occludes
+    culler.clearOccluders();
+    const std::vector<TestVertex> crossing = {
+        { { -5.0f, -5.0f, -0.5f } }, { { 5.0f, -5.0f, -10.0f } }, { { 5.0f, 5.0f, -10.0f } },
+        { { -5.0f, -5.0f, -10.0f } }, { { 5.0f, 5.0f, -10.0f } }, { { -5.0f, 5.0f, -10.0f } },
+    };
+    culler.addOccluder(crossing, identity);
+    culler.render(viewProjection, pool);
+    check(visible(culler, -1.0f, -1.0f, -21.0f, 1.0f, 1.0f, -19.0f), "a triangle crossing the near plane is left out");
+    check(!visible(culler, -8.0f, 4.0f, -21.0f, -6.0f, 6.0f, -19.0f), "the rest of the occluder still occludes");
+}
+
+int main()
+{
+    testWall(nullptr);
+
+    ThreadPool pool(2);
+    testWall(&pool);
+
+    if (failures == 0) std::printf("All occlusion tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
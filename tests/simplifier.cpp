@@ -0,0 +1,154 @@
+// Simplifies a flat grid and a sphere with MeshSimplifier and checks the triangle counts, that borders
+// stay in place, that the levels of detail get coarser with growing errors, and index counts that end
+// in a partial triangle.
+
+#include <gl.utilities/gl.utilities.simplifier.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct Position
+{
+    typedef float value_type;
+    float x, y, z;
+};
+
+struct TestVertex
+{
+    Position pos;
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        failures++;
+    }
+}
+
+// A grid of size by size quads in the xy plane, or wrapped around a sphere with the first and last
+// column of vertices at the same position
+static void grid(int size, bool sphere, std::vector<TestVertex>& verts, std::vector<unsigned int>& indices)
+{
+    for (int y = 0; y <= size; y++)
+    {
+        for (int x = 0; x <= size; x++)
+        {
+            auto theta = 3.14159265f * float(y) / float(size), phi = 6.2831853f * float(x) / float(size);
+            if (sphere) verts.push_back({ { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) } });
+            else verts.push_back({ { float(x), float(y), 0.0f } });
+        }
+    }
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            auto corner = (unsigned int)(y * (size + 1) + x);
+            auto below = corner + (unsigned int)(size + 1);
+            indices.insert(indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    }
+}
+
+static bool valid(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    if (indices.size() % 3 != 0) return false;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount) return false;
+        if (indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i] == indices[i + 2]) return false;
+    }
+    return true;
+}
+
+static void testFlatGrid()
+{
+    std::vector<TestVertex> verts;
+    std::vector<unsigned int> indices;
+    grid(16, false, verts, indices);
+
+    MeshSimplifier simplifier;
+    check(simplifier.prepare(verts, indices), "a vertex type with a float position can be simplified");
+
+    MeshSimplifier::Level level;
+    simplifier.simplify(indices, indices.size() / 4, level);
+    check(valid(level.indices, verts.size()), "the simplified grid holds whole triangles of existing vertices");
+    check(level.indices.size() <= indices.size() / 4 + 6 && level.indices.size() > 0, "the grid is simplified close to the target");
+    check(level.error < 1e-4f, "collapses within a plane cost nothing");
+
+    std::vector<bool> used(verts.size(), false);
+    for (auto index : level.indices) used[index] = true;
+    bool border = true;
+    for (int i = 0; i <= 16; i++)
+    {
+        border = border && used[size_t(i)] && used[size_t(16 * 17 + i)] && used[size_t(i * 17)] && used[size_t(i * 17 + 16)];
+    }
+    check(border, "the vertices on the border stay");
+}
+
+static void testSphereLods()
+{
+    std::vector<TestVertex> verts;
+    std::vector<unsigned int> indices;
+    grid(32, true, verts, indices);
+
+    MeshSimplifier simplifier;
+    simplifier.prepare(verts, indices);
+    check(std::fabs(simplifier.radius() - 1.0f) < 1e-3f, "the radius of the unit sphere is one");
+
+    std::vector<MeshSimplifier::Level> levels;
+    ThreadPool pool(2);
+    simplifier.buildLods(indices, 4, 0.5f, levels, &pool);
+    check(levels.size() == 3, "levels 1 to 3 are built");
+
+    auto previousCount = indices.size();
+    auto previousError = 0.0f;
+    for (auto& level : levels)
+    {
+        check(valid(level.indices, verts.size()), "every level holds whole triangles of existing vertices");
+        check(level.indices.size() < previousCount, "every level has fewer triangles than the one before");
+        check(level.error > 0.0f && level.error >= previousError, "the errors of the levels grow");
+        previousCount = level.indices.size();
+        previousError = level.error;
+    }
+
+    // The same collapses measured against only the level they start from, rather than the quadrics
+    // carried over from the full sphere, underestimate the error
+    MeshSimplifier::Level fromPrevious;
+    simplifier.simplify(levels[1].indices, levels[2].indices.size(), fromPrevious);
+    check(levels[2].error > fromPrevious.error, "the error of a level is measured against the full mesh");
+}
+
+static void testPartialTriangle()
+{
+    std::vector<TestVertex> verts;
+    std::vector<unsigned int> indices;
+    grid(4, false, verts, indices);
+    indices.push_back(0);
+    indices.push_back(1);
+
+    MeshSimplifier simplifier;
+    simplifier.prepare(verts, indices);
+
+    MeshSimplifier::Level level;
+    simplifier.simplify(indices, 12, level);
+    check(valid(level.indices, verts.size()), "a trailing partial triangle is left out of the simplified level");
+
+    std::vector<MeshSimplifier::Level> levels;
+    simplifier.buildLods(indices, 2, 0.5f, levels);
+    check(levels.size() == 1 && valid(levels[0].indices, verts.size()), "a trailing partial triangle is left out of the levels");
+}
+
+int main()
+{
+    testFlatGrid();
+    testSphereLods();
+    testPartialTriangle();
+
+    if (failures == 0) std::printf("All simplifier tests passed\n");
+    return failures == 0 ? 0 : 1;
+}